@@ -0,0 +1,118 @@
+#include "header.h"
+#include <cstdlib>
+#include <new>
+
+//Counter of the heap allocations done through operator new by each
+//thread, used to check that the time-stepping callbacks do not allocate.
+//Only C++ allocations are seen (not malloc from C libraries as hypre or
+//SuperLU), and the global operators are only replaced when compiled
+//with COUNT_ALLOCATIONS (local_config.mk)
+static thread_local long allocations = 0;
+
+long AllocationCount(){
+    return allocations;
+}
+
+bool AllocationsCounted(){
+#ifdef COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef COUNT_ALLOCATIONS
+void *operator new(std::size_t size){
+    allocations++;
+    void *ptr = std::malloc(size > 0 ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](std::size_t size){
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept{
+    allocations++;
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept{
+    return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept{
+    std::free(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept{
+    std::free(ptr);
+}
+#endif
+
+#ifdef __cpp_aligned_new
+//aligned_alloc needs a size multiple of the alignment
+void *operator new(std::size_t size, std::align_val_t align){
+    allocations++;
+    std::size_t alignment = static_cast<std::size_t>(align);
+    void *ptr = std::aligned_alloc(alignment, (max(size, (std::size_t)1) + alignment - 1)/alignment*alignment);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t align){
+    return operator new(size, align);
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept{
+    try { return operator new(size, align); }
+    catch (...) { return NULL; }
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &tag) noexcept{
+    return operator new(size, align, tag);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept{
+    std::free(ptr);
+}
+#endif
+#endif
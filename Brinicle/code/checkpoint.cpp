@@ -0,0 +1,371 @@
+#include "header.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+/****
+ * Binary checkpoint (independent of the number of processors)
+ *
+ * char[8]   "BRINICLE"
+ * int       version, order, serial refinements
+ * int       iteration, vis_iteration, vis_print
+ * double    time, next step size of ARKODE
+ * long      bytes of the serial mesh (MFEM text format) + mesh
+ * long      dofs of the serial H1 space
+ * int       encoding (0 raw, 1 lossy), version 2
+ * double[]  temperature, salinity, vorticity and stream (raw) or
+ * block     compressed values of each field (CompressField)
+ *
+ * The serial mesh can not be gathered from nonconforming (adapted)
+ * meshes, so then each processor writes its part to name.rank with
+ * version 3: the local mesh (ParPrint, with its refinement tree) and
+ * the local true dofs of the fields. It is restarted on the same
+ * number of processors.
+ *
+ * The name of the last complete checkpoint is kept in latest.txt,
+ * followed by the number of processors of a parallel one
+ ****/
+static const char checkpoint_magic[8] = {'B','R','I','N','I','C','L','E'};
+static const int checkpoint_version = 2;
+static const int checkpoint_parallel_version = 3;
+static const string checkpoint_folder = "results/restart/";
+static const string checkpoint_latest = checkpoint_folder + "latest.txt";
+
+//Set by SIGTERM/SIGUSR1, a last checkpoint is written before exiting
+static volatile sig_atomic_t checkpoint_signal = 0;
+
+//Set by the writer thread once its file is written
+static std::atomic<bool> checkpoint_written(true);
+
+static void checkpoint_handler(int signal){
+    checkpoint_signal = 1;
+}
+
+//Copy of the state handed to the writer thread
+struct Checkpoint_Snapshot{
+    Mesh *mesh;
+    string mesh_text;
+    int processors, rank;
+    Vector fields[4];
+    int header[6];
+    double times[2];
+    string name;
+    int encoding;
+    double tolerances[2];
+};
+
+//Append raw data to the buffer
+template <typename T>
+static void pack(string &buffer, const T *data, long size){
+    buffer.append(reinterpret_cast<const char*>(data), size*sizeof(T));
+}
+
+//Read raw data from the buffer
+template <typename T>
+static void unpack(const string &buffer, size_t &position, T *data, long size){
+    MFEM_VERIFY(position + size*sizeof(T) <= buffer.size(), "Truncated checkpoint");
+    memcpy(data, buffer.data() + position, size*sizeof(T));
+    position += size*sizeof(T);
+}
+
+//Write a file at once, through a temporary file so an 
+//interrupted write never replaces a complete one
+static void write_file(const string &name, const string &buffer){
+    string temporary = name + ".tmp";
+    std::ofstream out(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(buffer.data(), buffer.size());
+    out.close();
+    std::rename(temporary.c_str(), name.c_str());
+}
+
+//File of the part of a parallel checkpoint
+static string checkpoint_part(const string &name, int rank){
+    std::ostringstream oss;
+    oss << name << "." << std::setw(6) << std::setfill('0') << rank;
+    return oss.str();
+}
+
+//Pack and write a snapshot (runs in the writer thread)
+static void write_checkpoint(Checkpoint_Snapshot *snapshot, std::deque<string> *files, int keep, double *write_time){
+
+    Trace_Span span("Checkpoint write");
+    auto start = std::chrono::steady_clock::now();
+
+    string mesh_text = snapshot->mesh_text;
+    if (snapshot->mesh){
+        std::ostringstream mesh_out;
+        mesh_out.precision(16);
+        snapshot->mesh->Print(mesh_out);
+        mesh_text = mesh_out.str();
+    }
+    long mesh_bytes = mesh_text.size();
+    long size = snapshot->fields[0].Size();
+
+    string buffer;
+    buffer.reserve(8 + sizeof(snapshot->header) + sizeof(snapshot->times) + 2*sizeof(long) + mesh_bytes + 4*size*sizeof(double));
+    pack(buffer, checkpoint_magic, 8);
+    pack(buffer, snapshot->header, 6);
+    pack(buffer, snapshot->times, 2);
+    pack(buffer, &mesh_bytes, 1);
+    pack(buffer, mesh_text.data(), mesh_bytes);
+    pack(buffer, &size, 1);
+    pack(buffer, &snapshot->encoding, 1);
+    for (int ii = 0; ii < 4; ii++){
+        if (snapshot->encoding == 1)
+            CompressField(snapshot->fields[ii].GetData(), size, snapshot->tolerances[0], snapshot->tolerances[1], buffer);
+        else
+            pack(buffer, snapshot->fields[ii].GetData(), size);
+    }
+
+    //The parts of a parallel checkpoint become the latest one once all
+    //of them are written (commit_checkpoints), until then the previous
+    //checkpoint is also kept
+    string file = snapshot->name;
+    if (snapshot->processors > 0){
+        file = checkpoint_part(snapshot->name, snapshot->rank);
+        keep++;
+    }
+    write_file(checkpoint_folder + file, buffer);
+    if (snapshot->processors == 0)
+        write_file(checkpoint_latest, snapshot->name + "\n");
+
+    //Keep only the last checkpoints
+    files->push_back(file);
+    while ((int)files->size() > max(keep, 1)){
+        std::remove((checkpoint_folder + files->front()).c_str());
+        files->pop_front();
+    }
+
+    delete snapshot->mesh;
+    delete snapshot;
+    *write_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    checkpoint_written = true;
+}
+
+//Listen to the signals of the scheduler
+void Artic_sea::start_checkpoints(){
+    std::signal(SIGTERM, checkpoint_handler);
+    std::signal(SIGUSR1, checkpoint_handler);
+    checkpoint_clock = MPI_Wtime();
+}
+
+//Decide (equally on all processors) if a checkpoint is needed
+bool Artic_sea::checkpoint_due(){
+
+    Region_Timer timer(REGION_CHECKPOINT);
+    double start = MPI_Wtime();
+
+    int local[3] = {checkpoint_signal, 0, !checkpoint_written}, global[3];
+    if (config.master && config.checkpoint_time > 0. && start - checkpoint_clock > config.checkpoint_time)
+        local[1] = 1;
+    MPI_Allreduce(local, global, 3, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    //A parallel checkpoint becomes the latest one as soon as all its
+    //parts are written, not at the next checkpoint
+    if (!checkpoint_pending.empty() && !global[2])
+        commit_checkpoints();
+    checkpoint_overhead += MPI_Wtime() - start;
+
+    //Stop the simulation, the final checkpoint is written on exit
+    if (global[0] && !last){
+        if (config.master) cout << "\nSignal received, writing the final checkpoint\n";
+        last = true;
+    }
+    if (last) return false;
+
+    return global[1] || (config.checkpoint_steps > 0 && iteration % config.checkpoint_steps == 0);
+}
+
+//Gather the state and hand it to the writer thread
+void Artic_sea::save_checkpoint(){
+
+    Region_Timer timer(REGION_CHECKPOINT);
+    double start = MPI_Wtime();
+
+    //Only one checkpoint is written at a time
+    commit_checkpoints();
+
+    Checkpoint_Snapshot *snapshot = new Checkpoint_Snapshot;
+    snapshot->mesh = NULL;
+    snapshot->processors = 0;
+    snapshot->rank = config.pid;
+    if (!pmesh->Nonconforming()){
+        //Serial mesh and fields in the master
+        temperature->Distribute(X.GetBlock(0));
+        salinity->Distribute(X.GetBlock(1));
+        vorticity->Distribute(Y.GetBlock(0));
+        stream->Distribute(Y.GetBlock(1));
+
+        snapshot->mesh = new Mesh(pmesh->GetSerialMesh(0));
+        ParGridFunction *fields[4] = {temperature, salinity, vorticity, stream};
+        for (int ii = 0; ii < 4; ii++){
+            GridFunction serial_field = fields[ii]->GetSerialGridFunction(0, *snapshot->mesh);
+            snapshot->fields[ii] = serial_field;
+        }
+    } else {
+        //Local part of the mesh and fields in each processor
+        std::ostringstream mesh_out;
+        mesh_out.precision(16);
+        pmesh->ParPrint(mesh_out);
+        snapshot->mesh_text = mesh_out.str();
+        snapshot->processors = config.nproc;
+
+        const Vector *blocks[4] = {&X.GetBlock(0), &X.GetBlock(1), &Y.GetBlock(0), &Y.GetBlock(1)};
+        for (int ii = 0; ii < 4; ii++)
+            snapshot->fields[ii] = *blocks[ii];
+    }
+
+    double dt_next = dt;
+    ARKStepGetCurrentStep(arkode->GetMem(), &dt_next);
+
+    std::ostringstream oss;
+    oss << "checkpoint_" << std::setw(10) << std::setfill('0') << iteration << ".bin";
+    snapshot->name = oss.str();
+    if (snapshot->processors > 0)
+        checkpoint_pending = snapshot->name;
+
+    if (config.master || snapshot->processors > 0){
+        int version = (snapshot->processors > 0) ? checkpoint_parallel_version : checkpoint_version;
+        int header[6] = {version, config.order, serial_refinements, iteration, vis_iteration, vis_print};
+        memcpy(snapshot->header, header, sizeof(header));
+        snapshot->times[0] = t;
+        snapshot->times[1] = dt_next;
+        snapshot->encoding = config.lossy_checkpoint ? 1 : 0;
+        snapshot->tolerances[0] = config.lossy_abstol;
+        snapshot->tolerances[1] = config.lossy_reltol;
+
+        checkpoint_written = false;
+        checkpoint_writer = std::thread(write_checkpoint, snapshot, &checkpoint_files, config.checkpoint_keep, &checkpoint_write_time);
+    } else {
+        delete snapshot->mesh;
+        delete snapshot;
+    }
+
+    checkpoints++;
+    checkpoint_clock = MPI_Wtime();
+    checkpoint_overhead += checkpoint_clock - start;
+}
+
+//Wait for the writer thread
+void Artic_sea::finish_checkpoints(){
+    if (checkpoint_writer.joinable())
+        checkpoint_writer.join();
+}
+
+//Wait for the writer thread and, once all the processors wrote their
+//part of a parallel checkpoint, make it the latest one
+void Artic_sea::commit_checkpoints(){
+    finish_checkpoints();
+    if (checkpoint_pending.empty()) return;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (config.master)
+        write_file(checkpoint_latest, checkpoint_pending + " " + to_string(config.nproc) + "\n");
+    checkpoint_pending.clear();
+}
+
+//Read the last checkpoint, returning the serial mesh (or NULL if the
+//checkpoint is parallel, then the parallel mesh is created here)
+Mesh *Artic_sea::load_checkpoint(){
+
+    string name;
+    int processors = 0;
+    std::ifstream in(checkpoint_latest.c_str(), std::ios::in);
+    MFEM_VERIFY(in.good(), "Cannot open " << checkpoint_latest);
+    in >> name >> processors;
+    in.close();
+
+    if (processors > 0){
+        MFEM_VERIFY(processors == config.nproc, "Checkpoint of an adapted mesh written with " << processors 
+                    << " processors, it must be restarted with the same number");
+        name = checkpoint_part(name, config.pid);
+    }
+
+    in.open((checkpoint_folder + name).c_str(), std::ios::in | std::ios::binary);
+    MFEM_VERIFY(in.good(), "Cannot open " << checkpoint_folder + name);
+    checkpoint_buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    in.close();
+
+    size_t position = 0;
+    char magic[8];
+    int header[6];
+    double times[2];
+    long mesh_bytes;
+    unpack(checkpoint_buffer, position, magic, 8);
+    MFEM_VERIFY(memcmp(magic, checkpoint_magic, 8) == 0, "Invalid checkpoint " << name);
+    unpack(checkpoint_buffer, position, header, 6);
+    MFEM_VERIFY(header[0] >= 1 && header[0] <= checkpoint_parallel_version, "Unsupported checkpoint version " << header[0]);
+    MFEM_VERIFY((header[0] == checkpoint_parallel_version) == (processors > 0), "Invalid checkpoint " << name);
+    MFEM_VERIFY(header[1] == config.order, "Checkpoint written with order " << header[1]);
+    unpack(checkpoint_buffer, position, times, 2);
+    unpack(checkpoint_buffer, position, &mesh_bytes, 1);
+
+    serial_refinements = header[2];
+    iteration = header[3];
+    vis_iteration = header[4];
+    vis_print = header[5];
+    dt_restart = times[1];
+
+    //The checkpoint time is the exact initial time
+    config.t_final += times[0] - config.t_init;
+    t = config.t_init = times[0];
+
+    //The mesh is read as it was written (no reordering)
+    std::istringstream mesh_in(checkpoint_buffer.substr(position, mesh_bytes));
+    position += mesh_bytes;
+    checkpoint_position = position;
+    checkpoint_format = header[0];
+
+    if (processors > 0){
+        pmesh = new ParMesh(MPI_COMM_WORLD, mesh_in, false);
+        return NULL;
+    }
+    return new Mesh(mesh_in, 1, 0, false);
+}
+
+//Distribute the fields of the checkpoint over the parallel mesh (the
+//fields of a parallel checkpoint are already the local true dofs)
+void Artic_sea::load_checkpoint_fields(Mesh *serial_mesh, const int *partitioning){
+
+    size_t position = checkpoint_position;
+    long size;
+    int encoding = 0;
+    unpack(checkpoint_buffer, position, &size, 1);
+    if (checkpoint_format >= 2) unpack(checkpoint_buffer, position, &encoding, 1);
+
+    Vector *blocks[4] = {&X.GetBlock(0), &X.GetBlock(1), &Y.GetBlock(0), &Y.GetBlock(1)};
+    if (!serial_mesh){
+        MFEM_VERIFY(size == blocks[0]->Size(), "Checkpoint does not match the mesh");
+        for (int ii = 0; ii < 4; ii++){
+            if (encoding == 1){
+                DecompressField(checkpoint_buffer, position, *blocks[ii]);
+                MFEM_VERIFY(blocks[ii]->Size() == size, "Checkpoint does not match the mesh");
+            } else {
+                unpack(checkpoint_buffer, position, blocks[ii]->GetData(), size);
+            }
+        }
+        checkpoint_buffer.clear();
+        checkpoint_buffer.shrink_to_fit();
+        return;
+    }
+
+    FiniteElementSpace serial_fespace(serial_mesh, fec_H1);
+    MFEM_VERIFY(size == serial_fespace.GetVSize(), "Checkpoint does not match the mesh");
+
+    GridFunction serial_field(&serial_fespace);
+    for (int ii = 0; ii < 4; ii++){
+        if (encoding == 1){
+            DecompressField(checkpoint_buffer, position, serial_field);
+            MFEM_VERIFY(serial_field.Size() == size, "Checkpoint does not match the mesh");
+        } else {
+            unpack(checkpoint_buffer, position, serial_field.GetData(), size);
+        }
+        ParGridFunction field(pmesh, &serial_field, partitioning);
+        field.GetTrueDofs(*blocks[ii]);
+    }
+
+    checkpoint_buffer.clear();
+    checkpoint_buffer.shrink_to_fit();
+}
@@ -0,0 +1,278 @@
+#include "header.h"
+#include <cstring>
+#include <cstdint>
+
+/****
+ * Error-bounded lossy codec of the values of a field
+ *
+ * int       size, mode (0 raw, 1 lossy)
+ * double    error bound
+ * long      bytes + data
+ *
+ * Each value is predicted by the previous reconstructed one and
+ * the difference is quantized in steps of twice the bound. The
+ * quantized differences (mostly 0 for smooth fields) are written
+ * with an adaptive binary range coder, the values that can not be
+ * represented within the bound are stored exactly
+ ****/
+static const int probability_bits = 11;
+static const int adaptation_shift = 5;
+static const int escape = 32;
+
+//Binary range coder (LZMA style carry propagation)
+class Range_Encoder{
+    public:
+        Range_Encoder(string &out): out(out), low(0), range(0xFFFFFFFFu), cache(0), cache_size(1) {}
+
+        void Encode(uint16_t &probability, int bit){
+            uint32_t bound = (range >> probability_bits)*probability;
+            if (!bit){
+                range = bound;
+                probability += ((1 << probability_bits) - probability) >> adaptation_shift;
+            } else {
+                low += bound;
+                range -= bound;
+                probability -= probability >> adaptation_shift;
+            }
+            Normalize();
+        }
+
+        //Bits with probability 1/2
+        void EncodeDirect(uint64_t value, int bits){
+            for (int ii = bits - 1; ii >= 0; ii--){
+                range >>= 1;
+                if ((value >> ii) & 1) low += range;
+                Normalize();
+            }
+        }
+
+        void Flush(){
+            for (int ii = 0; ii < 5; ii++)
+                ShiftLow();
+        }
+    protected:
+        void Normalize(){
+            while (range < (1u << 24)){
+                range <<= 8;
+                ShiftLow();
+            }
+        }
+
+        void ShiftLow(){
+            if ((uint32_t)low < 0xFF000000u || (low >> 32) != 0){
+                uint8_t carry = low >> 32;
+                uint8_t temp = cache;
+                do {
+                    out.push_back((char)(uint8_t)(temp + carry));
+                    temp = 0xFF;
+                } while (--cache_size != 0);
+                cache = (uint8_t)(low >> 24);
+            }
+            cache_size++;
+            low = (low & 0x00FFFFFFu) << 8;
+        }
+
+        string &out;
+        uint64_t low;
+        uint32_t range;
+        uint8_t cache;
+        uint64_t cache_size;
+};
+
+class Range_Decoder{
+    public:
+        Range_Decoder(const char *data, long bytes): data(data), end(data + bytes), code(0), range(0xFFFFFFFFu) {
+            for (int ii = 0; ii < 5; ii++)
+                code = (code << 8) | Next();
+        }
+
+        int Decode(uint16_t &probability){
+            uint32_t bound = (range >> probability_bits)*probability;
+            int bit;
+            if (code < bound){
+                range = bound;
+                probability += ((1 << probability_bits) - probability) >> adaptation_shift;
+                bit = 0;
+            } else {
+                code -= bound;
+                range -= bound;
+                probability -= probability >> adaptation_shift;
+                bit = 1;
+            }
+            Normalize();
+            return bit;
+        }
+
+        uint64_t DecodeDirect(int bits){
+            uint64_t value = 0;
+            for (int ii = 0; ii < bits; ii++){
+                range >>= 1;
+                int bit = (code >= range);
+                if (bit) code -= range;
+                value = (value << 1) | bit;
+                Normalize();
+            }
+            return value;
+        }
+    protected:
+        void Normalize(){
+            while (range < (1u << 24)){
+                range <<= 8;
+                code = (code << 8) | Next();
+            }
+        }
+
+        uint8_t Next(){
+            return (data < end) ? (uint8_t)*data++ : 0;
+        }
+
+        const char *data, *end;
+        uint32_t code;
+        uint32_t range;
+};
+
+//Adaptive probabilities of the Elias-gamma code of the symbols
+struct Codec_Model{
+    Codec_Model(){
+        for (int ii = 0; ii <= escape; ii++){
+            length[ii] = 1 << (probability_bits - 1);
+            for (int jj = 0; jj < escape; jj++)
+                mantissa[ii][jj] = 1 << (probability_bits - 1);
+        }
+    }
+    uint16_t length[escape + 1];
+    uint16_t mantissa[escape + 1][escape];
+};
+
+//Symbol w >= 0 as the bit length k of w + 1 (unary) and its lower k bits, k = 32 is the escape
+static void encode_symbol(Range_Encoder &encoder, Codec_Model &model, uint64_t symbol, int bits){
+    for (int ii = 0; ii < bits; ii++)
+        encoder.Encode(model.length[ii], 1);
+    if (bits < escape) encoder.Encode(model.length[bits], 0);
+    if (bits == escape) return;
+    for (int ii = bits - 1; ii >= 0; ii--)
+        encoder.Encode(model.mantissa[bits][ii], ((symbol + 1) >> ii) & 1);
+}
+
+//Returns -1 for the escape
+static long decode_symbol(Range_Decoder &decoder, Codec_Model &model){
+    int bits = 0;
+    while (bits < escape && decoder.Decode(model.length[bits]))
+        bits++;
+    if (bits == escape) return -1;
+    uint64_t value = 1;
+    for (int ii = bits - 1; ii >= 0; ii--)
+        value = (value << 1) | decoder.Decode(model.mantissa[bits][ii]);
+    return value - 1;
+}
+
+template <typename T>
+static void append(string &buffer, const T &value){
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static T extract(const string &buffer, size_t &position){
+    T value;
+    MFEM_VERIFY(position + sizeof(T) <= buffer.size(), "Truncated compressed field");
+    memcpy(&value, buffer.data() + position, sizeof(T));
+    position += sizeof(T);
+    return value;
+}
+
+//Error-bounded lossy compression of the values of a field, the
+//reconstruction differs at most max(abstol, reltol*range) from them
+void CompressField(const double *values, int size, double abstol, double reltol, string &buffer){
+
+    double min_value = 0., max_value = 0.;
+    if (size > 0){
+        min_value = max_value = values[0];
+        for (int ii = 1; ii < size; ii++){
+            min_value = min(min_value, values[ii]);
+            max_value = max(max_value, values[ii]);
+        }
+    }
+    double bound = max(abstol, reltol*(max_value - min_value));
+    int mode = (bound > 0. && std::isfinite(bound)) ? 1 : 0;
+
+    append(buffer, size);
+    append(buffer, mode);
+    append(buffer, bound);
+
+    //Values stored as they are
+    if (mode == 0){
+        long bytes = size*sizeof(double);
+        append(buffer, bytes);
+        buffer.append(reinterpret_cast<const char*>(values), bytes);
+        return;
+    }
+
+    string data;
+    Range_Encoder encoder(data);
+    Codec_Model model;
+    double step = 2*bound, previous = 0.;
+    const double limit = (double)(1L << 30);
+    for (int ii = 0; ii < size; ii++){
+        double quotient = (values[ii] - previous)/step;
+        bool exact = !(std::fabs(quotient) < limit);
+        long quantized = 0;
+        double reconstructed = values[ii];
+        if (!exact){
+            quantized = std::lround(quotient);
+            reconstructed = previous + step*quantized;
+            exact = !(std::fabs(reconstructed - values[ii]) <= bound);
+        }
+        if (exact){
+            uint64_t raw;
+            memcpy(&raw, &values[ii], sizeof(double));
+            encode_symbol(encoder, model, 0, escape);
+            encoder.EncodeDirect(raw, 64);
+            previous = values[ii];
+        } else {
+            uint64_t symbol = (quantized >= 0) ? 2*quantized : -2*quantized - 1;
+            int bits = 0;
+            while (((symbol + 1) >> (bits + 1)) != 0) bits++;
+            encode_symbol(encoder, model, symbol, bits);
+            previous = reconstructed;
+        }
+    }
+    encoder.Flush();
+
+    long bytes = data.size();
+    append(buffer, bytes);
+    buffer.append(data);
+}
+
+//Reconstruct the values written by CompressField (position is advanced)
+void DecompressField(const string &buffer, size_t &position, Vector &values){
+
+    int size = extract<int>(buffer, position);
+    int mode = extract<int>(buffer, position);
+    double bound = extract<double>(buffer, position);
+    long bytes = extract<long>(buffer, position);
+    MFEM_VERIFY(position + bytes <= buffer.size(), "Truncated compressed field");
+
+    values.SetSize(size);
+    if (mode == 0){
+        MFEM_VERIFY(bytes == (long)(size*sizeof(double)), "Invalid compressed field");
+        memcpy(values.GetData(), buffer.data() + position, bytes);
+        position += bytes;
+        return;
+    }
+
+    Range_Decoder decoder(buffer.data() + position, bytes);
+    Codec_Model model;
+    double step = 2*bound, previous = 0.;
+    for (int ii = 0; ii < size; ii++){
+        long symbol = decode_symbol(decoder, model);
+        if (symbol < 0){
+            uint64_t raw = decoder.DecodeDirect(64);
+            memcpy(&values[ii], &raw, sizeof(double));
+        } else {
+            long quantized = (symbol % 2 == 0) ? symbol/2 : -(symbol + 1)/2;
+            values[ii] = previous + step*quantized;
+        }
+        previous = values[ii];
+    }
+    position += bytes;
+}
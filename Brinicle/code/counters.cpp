@@ -0,0 +1,93 @@
+#include "header.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+/****
+ * Hardware counters of the main thread (Linux perf_event) read by the
+ * region timers: cycles, instructions and last level cache misses. The
+ * events are opened as one group so they are scheduled together, and
+ * scaled if the kernel multiplexes them. Events that cannot be opened
+ * (no PMU in a container, perf_event_paranoid, other systems) are
+ * reported as not available and the rest keep counting
+ ****/
+thread_local bool counters_enabled = false;
+static const char *counter_names[HARDWARE_COUNTERS] = {"Cycles", "Instructions", "Cache misses"};
+static int counter_leader = -1;
+static int counter_fds[HARDWARE_COUNTERS] = {-1, -1, -1};
+static int counter_opened = 0;
+
+const char *CounterName(int counter){
+    return counter_names[counter];
+}
+
+#ifdef __linux__
+static int open_counter(unsigned long long config, int leader){
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (leader == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+#endif
+
+//Open the counters of the calling thread, returns the available ones
+//(bit i for counter i)
+int StartCounters(){
+    int available = 0;
+#ifdef __linux__
+    const unsigned long long configs[HARDWARE_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+    };
+    for (int ii = 0; ii < HARDWARE_COUNTERS; ii++){
+        counter_fds[ii] = open_counter(configs[ii], counter_leader);
+        if (counter_fds[ii] < 0) continue;
+        if (counter_leader < 0) counter_leader = counter_fds[ii];
+        available |= 1 << ii;
+        counter_opened++;
+    }
+    if (counter_leader >= 0){
+        ioctl(counter_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counter_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    counters_enabled = (available != 0);
+    return available;
+}
+
+//Current (scaled) values of the counters, the missing ones are 0
+void ReadCounters(double *values){
+    for (int ii = 0; ii < HARDWARE_COUNTERS; ii++)
+        values[ii] = 0.;
+#ifdef __linux__
+    unsigned long long data[3 + HARDWARE_COUNTERS];
+    if (read(counter_leader, data, sizeof(data)) < (ssize_t)((3 + counter_opened)*sizeof(unsigned long long)))
+        return;
+    double scale = (data[2] > 0) ? (double)data[1]/data[2] : 0.;
+    for (int ii = 0, jj = 0; ii < HARDWARE_COUNTERS; ii++)
+        if (counter_fds[ii] >= 0)
+            values[ii] = scale*data[3 + jj++];
+#endif
+}
+
+//Close the counters
+void StopCounters(){
+    counters_enabled = false;
+#ifdef __linux__
+    for (int ii = 0; ii < HARDWARE_COUNTERS; ii++)
+        if (counter_fds[ii] >= 0) close(counter_fds[ii]);
+#endif
+    for (int ii = 0; ii < HARDWARE_COUNTERS; ii++)
+        counter_fds[ii] = -1;
+    counter_leader = -1;
+    counter_opened = 0;
+}
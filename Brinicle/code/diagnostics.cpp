@@ -0,0 +1,111 @@
+#include "header.h"
+#include <cfloat>
+
+/****
+ * In-situ diagnostics (results/diagnostics.txt), axisymmetric integrals
+ * (2*pi*r weighted) of the state, extent of the ice and salt balance:
+ *
+ *   d(salt)/dt + salt outflux = residual
+ *
+ * where the outflux is the advective and diffusive flux of salt through
+ * the whole boundary (trapezoidal rule between two calls)
+ ****/
+static const int diagnostics_sums = 5;
+static const int diagnostics_size = 7;
+
+//Sum of the first entries and maximum of the last ones
+static void diagnostics_reduce(void *in, void *inout, int *length, MPI_Datatype *type){
+    double *a = (double*)in, *b = (double*)inout;
+    for (int ii = 0; ii < *length; ii++)
+        b[ii] = (ii < diagnostics_sums) ? b[ii] + a[ii] : max(b[ii], a[ii]);
+}
+
+//Compute the diagnostics of the current state and append them
+void Artic_sea::compute_diagnostics(){
+    Region_Timer timer(REGION_DIAGNOSTICS);
+
+    temperature->Distribute(X.GetBlock(0));
+    salinity->Distribute(X.GetBlock(1));
+    velocity->Distribute(Velocity);
+
+    //Local partial results: salt, heat, ice volume, kinetic energy,
+    //salt outflux, maximum z of the ice and -minimum z of the ice
+    double local[diagnostics_size] = {0., 0., 0., 0., 0., -DBL_MAX, -DBL_MAX};
+
+    Vector x(2), v(2), gradient(2), normal(2);
+    for (int ee = 0; ee < pmesh->GetNE(); ee++){
+        ElementTransformation *T = pmesh->GetElementTransformation(ee);
+        const IntegrationRule &ir = IntRules.Get(T->GetGeometryType(), 2*config.order + 2);
+        for (int ii = 0; ii < ir.GetNPoints(); ii++){
+            const IntegrationPoint &ip = ir.IntPoint(ii);
+            T->SetIntPoint(&ip);
+            T->Transform(ip, x);
+            double weight = 2*M_PI*x(0)*ip.weight*T->Weight();
+
+            double T_value = temperature->GetValue(*T, ip);
+            double S_value = salinity->GetValue(*T, ip);
+            double P_value = Phase(T_value, S_value);
+            velocity->GetVectorValue(*T, ip, v);
+
+            local[0] += weight*S_value;
+            local[1] += weight*T_value;
+            local[2] += weight*(1. - P_value);
+            local[3] += weight*0.5*(v*v);
+            if (P_value < 0.5){
+                local[5] = max(local[5], x(1));
+                local[6] = max(local[6], -x(1));
+            }
+        }
+    }
+
+    //Flux of salt through the boundary (outward normal)
+    for (int be = 0; be < pmesh->GetNBE(); be++){
+        FaceElementTransformations *F = pmesh->GetBdrFaceTransformations(be);
+        if (!F) continue;
+        const IntegrationRule &ir = IntRules.Get(F->GetGeometryType(), 2*config.order + 2);
+        for (int ii = 0; ii < ir.GetNPoints(); ii++){
+            const IntegrationPoint &ip = ir.IntPoint(ii);
+            F->SetAllIntPoints(&ip);
+            ElementTransformation &T = *F->Elem1;
+            const IntegrationPoint &eip = F->GetElement1IntPoint();
+            F->Transform(ip, x);
+            CalcOrtho(F->Jacobian(), normal);
+
+            double T_value = temperature->GetValue(T, eip);
+            double S_value = salinity->GetValue(T, eip);
+            velocity->GetVectorValue(T, eip, v);
+            salinity->GetGradient(T, gradient);
+
+            local[4] += 2*M_PI*x(0)*ip.weight*(S_value*(v*normal) - SaltDiffusivity(T_value, S_value)*(gradient*normal));
+        }
+    }
+
+    //All the results in one reduction (the operation is freed with the program)
+    if (diagnostics_operation == MPI_OP_NULL) MPI_Op_create(diagnostics_reduce, 1, &diagnostics_operation);
+    double global[diagnostics_size];
+    Trace_Span span("Diagnostics reduction");
+    MPI_Allreduce(local, global, diagnostics_size, MPI_DOUBLE, diagnostics_operation, MPI_COMM_WORLD);
+
+    //Salt balance since the last call
+    double residual = 0.;
+    if (diagnostics_time >= 0. && t > diagnostics_time)
+        residual = (global[0] - diagnostics_salt)/(t - diagnostics_time) + 0.5*(global[4] + diagnostics_flux);
+    bool first = diagnostics_time < 0.;
+    diagnostics_time = t;
+    diagnostics_salt = global[0];
+    diagnostics_flux = global[4];
+
+    if (config.master){
+        std::ofstream out;
+        out.open("results/diagnostics.txt", (first && !config.restart) ? std::ios::trunc : std::ios::app);
+        if (first && !config.restart)
+            out << "Time,Salt,Heat,Ice_volume,Kinetic_energy,Salt_outflux,Ice_z_min,Ice_z_max,Salt_residual\n";
+        bool ice = global[5] > -DBL_MAX;
+        out << std::setprecision(10)
+            << t << "," << global[0] << "," << global[1] << "," << global[2] << ","
+            << global[3] << "," << global[4] << ","
+            << (ice ? -global[6] : NAN) << "," << (ice ? global[5] : NAN) << ","
+            << residual << "\n";
+        out.close();
+    }
+}
@@ -20,9 +20,16 @@ Flow_Operator::Flow_Operator(Config config, ParFiniteElementSpace &fespace_H1, P
     temperature(&fespace_H1), salinity(&fespace_H1), 
     density(&fespace_H1), density_dr(&fespace_H1), 
     impermeability(&fespace_H1), 
+    b1_boundary(fespace_H1.GetVSize()),
     B(block_offsets_H1),
     B0(NULL), B1(NULL),
     A00(NULL), A01(NULL), A10(NULL), A11(NULL),
+    density_table(NULL),
+    H(NULL), H_superlu(NULL),
+    superlu_solver(NULL), factorized(false),
+    H_block(NULL), H_prec(NULL),
+    A10_A01(NULL), S(NULL), S_prec(NULL),
+    krylov(MPI_COMM_WORLD), krylov_solves(0), krylov_iterations(0),
     coeff_r(r_f), coeff_r_inv(r_inv_f), 
     coeff_r_inv_hat(dim, r_inv_hat_f),
     coeff_rot(dim, rot_f), 
@@ -32,6 +39,8 @@ Flow_Operator::Flow_Operator(Config config, ParFiniteElementSpace &fespace_H1, P
     coeff_stream_closed_down(0.), coeff_stream_closed_up(InflowFlux),
     gradient(&fespace_H1, &fespace_ND)
 { 
+    ResetLinearStatistics();
+
     /****
      * Define essential boundary conditions
      * 
@@ -80,6 +89,41 @@ Flow_Operator::Flow_Operator(Config config, ParFiniteElementSpace &fespace_H1, P
     ess_bdr_closed_up[3] = 1;
     ess_bdr_closed_up[5] = 1;
 
+    //Tabulate the equation of state, if the interpolation is not 
+    //accurate enough the analytic expression is kept
+    if (config.table_points > 0){
+        density_table = new Density_Table(config.table_points);
+        if (density_table->Error() > config.table_tol){
+            if (config.master)
+                cout << "\nDensity table error " << density_table->Error() 
+                     << " above tolerance " << config.table_tol 
+                     << ", using the analytic density\n";
+            delete density_table;
+            density_table = NULL;
+        }
+    }
+
+    //Configure the iterative solver, the previous solution 
+    //is used as initial guess
+    A00_prec.SetType(HypreSmoother::Jacobi);
+    S_amg.SetPrintLevel(0);
+    S_amg.SetReuse(config.amg_reuse);
+    S_prec = new ScaledOperator(&S_amg, -1.);
+
+    krylov.SetRelTol(config.reltol_flow);
+    krylov.SetAbsTol(0.);
+    krylov.SetMaxIter(config.iter_flow);
+    krylov.SetKDim(50);
+    krylov.SetPrintLevel(0);
+    krylov.iterative_mode = true;
+
+    gradient.AddDomainIntegrator(new GradientInterpolator);
+    AssembleConstant();
+}
+
+//Boundary values and forms that do not depend on (T,S)
+void Flow_Operator::AssembleConstant(){
+
     //Apply boundary conditions
     vorticity_boundary.ProjectCoefficient(coeff_vorticity);
     vorticity_boundary.ProjectBdrCoefficient(coeff_vorticity, ess_bdr_0);
@@ -113,12 +157,69 @@ Flow_Operator::Flow_Operator(Config config, ParFiniteElementSpace &fespace_H1, P
     a01.Finalize();
     A01 = a01.ParallelAssemble();
 
+    //A10 does not depend on (T,S), its boundary contribution 
+    //is added to the non-constant RHS on each step
+    b1_boundary = 0.;
+    ParMixedBilinearForm a10(&fespace_H1, &fespace_H1);
+    a10.AddDomainIntegrator(new MixedGradGradIntegrator);
+    a10.AddDomainIntegrator(new MixedDirectionalDerivativeIntegrator(coeff_r_inv_hat));
+    a10.Assemble();
+    a10.EliminateTrialDofs(ess_bdr_0, vorticity_boundary, b1_boundary);
+    a10.EliminateTestDofs(ess_bdr_1);    
+    a10.Finalize();
+    A10 = a10.ParallelAssemble();
+
     B0 = b0.ParallelAssemble();
 
     //Create gradient interpolator
-    gradient.AddDomainIntegrator(new GradientInterpolator);
     gradient.Assemble();
     gradient.Finalize();
+
+    //Blocks of the iterative solver that do not change
+    A00_prec.SetOperator(*A00);
+
+    delete H_block;
+    delete H_prec;
+    H_block = new BlockOperator(block_offsets_H1);
+    H_prec = new BlockLowerTriangularPreconditioner(block_offsets_H1);
+    H_block->SetBlock(0, 0, A00);
+    H_block->SetBlock(0, 1, A01);
+    H_prec->SetDiagonalBlock(0, &A00_prec);
+    krylov.SetPreconditioner(*H_prec);
+}
+
+//Adapt the operator to the spaces updated after a change of the mesh,
+//the solvers are kept and the forms that depend on (T,S) are
+//assembled again by SetParameters
+void Flow_Operator::Update(const Array<int> &block_offsets_H1){
+    this->block_offsets_H1 = block_offsets_H1;
+    B.Update(this->block_offsets_H1);
+    fespace_H1.GetEssentialTrueDofs(ess_bdr_0, ess_tdof_0);
+    fespace_H1.GetEssentialTrueDofs(ess_bdr_1, ess_tdof_1);
+
+    ParGridFunction *fields[11] = {&vorticity_boundary, &stream_boundary, &velocity, &rvelocity,
+                                   &stream, &stream_gradient, &temperature, &salinity,
+                                   &density, &density_dr, &impermeability};
+    for (int ii = 0; ii < 11; ii++)
+        fields[ii]->Update();
+    b1_boundary.SetSize(fespace_H1.GetVSize());
+    gradient.Update();
+
+    HypreParMatrix **matrices[6] = {&A00, &A01, &A10, &A11, &A10_A01, &H};
+    for (int ii = 0; ii < 6; ii++){
+        delete *matrices[ii];
+        *matrices[ii] = NULL;
+    }
+    delete B0; B0 = NULL;
+    delete B1; B1 = NULL;
+    delete H_superlu; H_superlu = NULL;
+    delete superlu_solver; superlu_solver = NULL;
+    factorized = false;
+
+    //S is replaced on the next solve, with a new hierarchy
+    S_amg.Invalidate();
+
+    AssembleConstant();
 }
 
 //Boundary condition for vorticity
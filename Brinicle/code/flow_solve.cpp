@@ -1,38 +1,214 @@
 #include "header.h"
+#include <superlu_ddefs.h>
 
 //Solution of the current system
 void Flow_Operator::Solve(BlockVector &Y, Vector &Velocity, Vector &rVelocity){
 
+    Region_Timer timer(REGION_FLOW_SOLVE);
+
     //Create the complete bilinear operator:
     //
     //   H = [ M    C ]
     //       [ C^t  D ]
+    //
+    //and solve it directly (SuperLU) or iteratively (FGMRES)
+
+    //Create the complete RHS
+    B.GetBlock(0) = *B0;
+    B.GetBlock(1) = *B1;
+
+    if (config.flow_solver == 0){
+        //H and its SuperLU copy are built on the first solve, later only
+        //the entries of A11 (the only block that changes) are overwritten
+        {
+            Trace_Span span("SuperLU matrix");
+            if (!H || !RefreshDirect())
+                AssembleDirect();
+        }
+
+        //The sparsity pattern of H is the same on every step, so after
+        //the first factorization the column permutation (and optionally
+        //the row permutation and symbolic factorization) are reused
+        if (!factorized || config.superlu_reuse == 0)
+            superlu_solver->SetFact(superlu::DOFACT);
+        else if (config.superlu_reuse == 1)
+            superlu_solver->SetFact(superlu::SamePattern);
+        else
+            superlu_solver->SetFact(superlu::SamePattern_SameRowPerm);
+        superlu_solver->SetOperator(*H_superlu);
+
+        //Solve the linear system Ax=B (SuperLU factorizes it here)
+        {
+            Trace_Span span("SuperLU factorization and solve");
+            superlu_solver->Mult(B, Y);
+        }
+        factorized = true;
+
+        //Residual after the iterative refinement of SuperLU
+        residual.SetSize(B.Size());
+        H->Mult(Y, residual);
+    } else {
+        H_block->SetBlock(1, 0, A10);
+        H_block->SetBlock(1, 1, A11);
+
+        //Approximate the Schur complement with the diagonal of the
+        //mass matrix, BoomerAMG is applied to -S as D is negative.
+        //C^t M_d^-1 C is constant, so only D is added on each solve
+        //and the hierarchy is kept while the iterations stay low
+        if (!A10_A01){
+            Vector A00_diag;
+            A00->GetDiag(A00_diag);
+            HypreParMatrix A01_scaled(*A01);
+            A01_scaled.InvScaleRows(A00_diag);
+            A10_A01 = ParMult(A10, &A01_scaled);
+        }
+
+        HypreParMatrix *S_old = S;
+        S = Add(1., *A10_A01, -1., *A11);
+        S_amg.SetOperator(*S);
+        delete S_old;
+
+        H_prec->SetDiagonalBlock(1, S_prec);
+        H_prec->SetBlock(1, 0, A10);
+
+        //Solve the linear system Ax=B
+        Trace_Span span("Flow FGMRES");
+        krylov.SetOperator(*H_block);
+        krylov.Mult(B, Y);
+        krylov_solves++;
+        krylov_iterations += krylov.GetNumIterations();
+        S_amg.Monitor(krylov.GetNumIterations());
+        if (!krylov.GetConverged() && config.master)
+            cout << "\nFlow solver did not converge in " << krylov.GetNumIterations() << " iterations\n";
+
+        residual.SetSize(B.Size());
+        H_block->Mult(Y, residual);
+    }
+
+    //True relative residual of the solution
+    Trace_Span span("Flow residual");
+    residual -= B;
+    double norm = InnerProduct(MPI_COMM_WORLD, B, B);
+    linear_statistics.solves++;
+    linear_statistics.iterations += (config.flow_solver == 0) ? 0 : krylov.GetNumIterations();
+    linear_statistics.residual = max(linear_statistics.residual, sqrt(InnerProduct(MPI_COMM_WORLD, residual, residual)/max(norm, 1E-300)));
+
+    UpdateVelocity(Y, Velocity, rVelocity);
+}
+
+//Value of the entry k (diagonal part) or -1-k (off-diagonal part) of A
+static inline double entry_value(hypre_ParCSRMatrix *A, int entry){
+    if (entry >= 0)
+        return hypre_CSRMatrixData(hypre_ParCSRMatrixDiag(A))[entry];
+    return hypre_CSRMatrixData(hypre_ParCSRMatrixOffd(A))[-1 - entry];
+}
+
+//Local values of the SuperLU matrix
+static inline NRformat_loc *superlu_store(SuperLURowLocMatrix *A){
+    return (NRformat_loc*)((SuperMatrix*)A->InternalData())->Store;
+}
+
+//Build H and its SuperLU copy, and find where the entries of A11 are
+void Flow_Operator::AssembleDirect(){
+    if (H_superlu) delete H_superlu;
+    if (H) delete H;
+
     Array2D<HypreParMatrix*> HBlocks(2,2);
     HBlocks(0, 0) = A00;
     HBlocks(0, 1) = A01;
     HBlocks(1, 0) = A10;
     HBlocks(1, 1) = A11;
+    H = HypreParMatrixFromBlocks(HBlocks);
+    H_superlu = new SuperLURowLocMatrix(*H);
+    factorized = false;
 
-    HypreParMatrix *H = HypreParMatrixFromBlocks(HBlocks);
-    SuperLURowLocMatrix A(*H);
+    //Configure the direct solver on a new mesh, its grid and
+    //factorization are kept alive between steps
+    if (!superlu_solver){
+        superlu_solver = new SuperLUSolver(MPI_COMM_WORLD);
+        superlu_solver->SetPrintStatistics(false);
+        superlu_solver->SetSymmetricPattern(true);
+        superlu_solver->SetColumnPermutation(superlu::PARMETIS);
+        superlu_solver->SetIterativeRefine(superlu::SLU_DOUBLE);
+    }
 
-    //Create the complete RHS
-    B.GetBlock(0) = *B0;
-    B.GetBlock(1) = *B1;
+    //Same matrix with the other blocks scaled by 0 and each entry of A11
+    //replaced by its index (k+1 in the diagonal part, -k-1 in the
+    //off-diagonal part), so its nonzeros mark the positions of A11
+    HypreParMatrix A11_index(*A11);
+    hypre_CSRMatrix *diag = hypre_ParCSRMatrixDiag((hypre_ParCSRMatrix*)A11_index);
+    hypre_CSRMatrix *offd = hypre_ParCSRMatrixOffd((hypre_ParCSRMatrix*)A11_index);
+    a11_diag_size = hypre_CSRMatrixNumNonzeros(diag);
+    a11_offd_size = hypre_CSRMatrixNumNonzeros(offd);
+    for (int kk = 0; kk < a11_diag_size; kk++)
+        hypre_CSRMatrixData(diag)[kk] = kk + 1.;
+    for (int kk = 0; kk < a11_offd_size; kk++)
+        hypre_CSRMatrixData(offd)[kk] = -kk - 1.;
+
+    Array2D<double> coefficients(2,2);
+    coefficients = 0.;
+    coefficients(1, 1) = 1.;
+    HBlocks(1, 1) = &A11_index;
+    HypreParMatrix *H_index = HypreParMatrixFromBlocks(HBlocks, &coefficients);
+    SuperLURowLocMatrix H_index_superlu(*H_index);
+
+    //Index k+1 -> entry k, index -k-1 -> entry -1-k
+    auto entry = [](double index){ return (index > 0) ? (int)index - 1 : (int)index; };
+
+    a11_H.clear();
+    a11_superlu.clear();
+    hypre_CSRMatrix *H_diag = hypre_ParCSRMatrixDiag((hypre_ParCSRMatrix*)*H_index);
+    hypre_CSRMatrix *H_offd = hypre_ParCSRMatrixOffd((hypre_ParCSRMatrix*)*H_index);
+    for (int pp = 0; pp < hypre_CSRMatrixNumNonzeros(H_diag); pp++)
+        if (hypre_CSRMatrixData(H_diag)[pp] != 0.)
+            a11_H.push_back({pp, entry(hypre_CSRMatrixData(H_diag)[pp])});
+    for (int pp = 0; pp < hypre_CSRMatrixNumNonzeros(H_offd); pp++)
+        if (hypre_CSRMatrixData(H_offd)[pp] != 0.)
+            a11_H.push_back({-1 - pp, entry(hypre_CSRMatrixData(H_offd)[pp])});
 
-    //Create the solver object
-    SuperLUSolver superlu(MPI_COMM_WORLD);
-    superlu.SetOperator(A);
-    superlu.SetPrintStatistics(false);
-    superlu.SetSymmetricPattern(true);
-    superlu.SetColumnPermutation(superlu::PARMETIS);
-    superlu.SetIterativeRefine(superlu::SLU_DOUBLE);
+    NRformat_loc *index_store = superlu_store(&H_index_superlu);
+    NRformat_loc *store = superlu_store(H_superlu);
+    const double *index_values = (const double*)index_store->nzval;
+    for (int pp = 0; pp < index_store->nnz_loc; pp++)
+        if (index_values[pp] != 0.)
+            a11_superlu.push_back({pp, entry(index_values[pp])});
+    H_values.assign((const double*)store->nzval, (const double*)store->nzval + store->nnz_loc);
+    delete H_index;
 
-    //Solve the linear system Ax=B
-    superlu.Mult(B, Y);
-    superlu.DismantleGrid();
+    //Both matrices must have the same pattern (no entries dropped)
+    int local_size = a11_diag_size + a11_offd_size;
+    if ((int)a11_H.size() != local_size || (int)a11_superlu.size() != local_size || index_store->nnz_loc != store->nnz_loc)
+        a11_diag_size = a11_offd_size = -1;
+}
+
+//Overwrite the entries of A11 in H and in its SuperLU copy
+bool Flow_Operator::RefreshDirect(){
+    hypre_ParCSRMatrix *a11 = *A11;
+    int ok = hypre_CSRMatrixNumNonzeros(hypre_ParCSRMatrixDiag(a11)) == a11_diag_size &&
+             hypre_CSRMatrixNumNonzeros(hypre_ParCSRMatrixOffd(a11)) == a11_offd_size;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok) return false;
+
+    double *H_diag = hypre_CSRMatrixData(hypre_ParCSRMatrixDiag((hypre_ParCSRMatrix*)*H));
+    double *H_offd = hypre_CSRMatrixData(hypre_ParCSRMatrixOffd((hypre_ParCSRMatrix*)*H));
+    for (const auto &position : a11_H){
+        if (position.first >= 0)
+            H_diag[position.first] = entry_value(a11, position.second);
+        else
+            H_offd[-1 - position.first] = entry_value(a11, position.second);
+    }
+
+    //All the values are copied again as SuperLU scales them in place
+    for (const auto &position : a11_superlu)
+        H_values[position.first] = entry_value(a11, position.second);
+    NRformat_loc *store = superlu_store(H_superlu);
+    std::copy(H_values.begin(), H_values.end(), (double*)store->nzval);
+    return true;
+}
 
-    //Calculate velocity field
+//Velocity field from the stream function
+void Flow_Operator::UpdateVelocity(const BlockVector &Y, Vector &Velocity, Vector &rVelocity){
+    Region_Timer timer(REGION_VELOCITY);
     stream.Distribute(Y.GetBlock(1)); 
     gradient.Mult(stream, stream_gradient);
     VectorGridFunctionCoefficient coeff_stream_gradient(&stream_gradient);
@@ -44,6 +220,19 @@ void Flow_Operator::Solve(BlockVector &Y, Vector &Velocity, Vector &rVelocity){
     //Export flow information
     velocity.ParallelAverage(Velocity);
     rvelocity.ParallelAverage(rVelocity);
+}
+
+//Number of iterative solves performed
+int Flow_Operator::GetSolves() const{
+    return krylov_solves;
+}
+
+//Number of Krylov iterations over all the iterative solves
+int Flow_Operator::GetIterations() const{
+    return krylov_iterations;
+}
 
-    delete H;
+//Start the statistics of the solves again
+void Flow_Operator::ResetLinearStatistics(){
+    linear_statistics = {0, 0, 0.};
 }
@@ -3,43 +3,50 @@
 //Create the mesh and the FES
 void Artic_sea::make_grid(const char *mesh_file){
 
-    //Read mesh (serial)
-    Mesh *mesh = new Mesh(mesh_file, 1, 1);
-    dim = mesh->Dimension();
-    
-    //Calculate how many serial refinements are needed
-    //More than 1000 cells per processor
-    int elements = mesh->GetNE();
-    int min_elements = 1000.*config.nproc;
-    if (min_elements > elements)
-        serial_refinements = min(config.refinements, (int)floor(log(min_elements/elements)/(dim*log(2.))));
-    else
-        serial_refinements = 0;
-    
+    //Read mesh (serial), or the refined mesh of the checkpoint
+    Mesh *mesh = NULL;
+    int *partitioning = NULL;
     if (!config.restart){
+        mesh = new Mesh(mesh_file, 1, 1);
+        dim = mesh->Dimension();
+
+        //Calculate how many serial refinements are needed
+        //More than 1000 cells per processor
+        int elements = mesh->GetNE();
+        int min_elements = 1000.*config.nproc;
+        if (min_elements > elements)
+            serial_refinements = min(config.refinements, (int)floor(log(min_elements/elements)/(dim*log(2.))));
+        else
+            serial_refinements = 0;
+
         //Refine mesh (serial)
         for (int ii = 0; ii < serial_refinements; ii++)
             mesh->UniformRefinement();
-    }
-    
-    //Make mesh (parallel), delete the serial
-    pmesh = new ParMesh(MPI_COMM_WORLD, *mesh);
-    delete mesh;
-    
-    if (!config.restart){
+
+        //The adaptive refinement needs a nonconforming mesh,
+        //its initial elements are the roots of the refinement
+        if (config.amr_steps > 0)
+            mesh->EnsureNCMesh(true);
+
+        //Make mesh (parallel)
+        pmesh = new ParMesh(MPI_COMM_WORLD, *mesh);
+        delete mesh;
+        mesh = NULL;
+
         //Refine mesh (parallel)
         for (int ii = 0; ii < config.refinements - serial_refinements; ii++)
             pmesh->UniformRefinement();
+        amr_base_depth = config.refinements - serial_refinements;
     } else {
-        //Read the input mesh
-        std::ifstream in;
-        std::ostringstream oss;
-        oss << std::setw(10) << std::setfill('0') << config.pid;
-        std::string n_mesh = "results/restart/pmesh_"+oss.str()+".msh";
-
-        in.open(n_mesh.c_str(),std::ios::in);
-        pmesh->Load(in,1,0); 
-        in.close();
+        //The mesh is partitioned for the current number of processors,
+        //an adapted mesh is read already partitioned
+        mesh = load_checkpoint();
+        if (mesh){
+            partitioning = mesh->GeneratePartitioning(config.nproc);
+            pmesh = new ParMesh(MPI_COMM_WORLD, *mesh, partitioning);
+        }
+        dim = pmesh->Dimension();
+        amr_base_depth = config.refinements - serial_refinements;
     }
 
     //Calculate minimum size of elements
@@ -63,4 +70,11 @@ void Artic_sea::make_grid(const char *mesh_file){
 
     X.Update(block_offsets_H1); X = 0.;
     Y.Update(block_offsets_H1); Y = 0.;
+
+    //Recover the state of the checkpoint
+    if (config.restart){
+        load_checkpoint_fields(mesh, partitioning);
+        delete[] partitioning;
+        delete mesh;
+    }
 }
@@ -4,6 +4,9 @@
 #include <fstream>
 #include <string>
 #include <cmath>
+#include <deque>
+#include <thread>
+#include <vector>
 #include "mfem.hpp"
 
 using namespace std;
@@ -84,6 +87,16 @@ struct Constants{
      * given by g/nu in 1/(mm*min)
      ****/ 
     double BuoyancyCoefficient = 8.647E+4;
+
+    /****
+     * Range covered by the tabulated equation of state
+     * (outside of it the analytic expression is used)
+     * in °C and g/kg
+     ****/
+    double Table_T_min = -30.;
+    double Table_T_max = 20.;
+    double Table_S_min = 0.;
+    double Table_S_max = 100.;
 };
 
 //Main variables for the program
@@ -100,6 +113,8 @@ struct Config{
     double dt_init;
     double t_final;
     int vis_steps_max;
+    double vis_time;
+    bool dense_flow;
     bool rescale;
 
     //FEM variables 
@@ -111,12 +126,116 @@ struct Config{
     double reltol_sundials;
     double abstol_sundials;
 
+    //Flow solver variables
+    int superlu_reuse;
+    int flow_solver;
+    double reltol_flow;
+    int iter_flow;
+
+    //Transport solver variables
+    bool partial_assembly;
+    double jacobian_ratio;
+    double amg_reuse;
+
+    //Equation of state variables
+    int table_points;
+    double table_tol;
+
+    //Adaptive mesh variables
+    int amr_steps;
+    int amr_levels;
+    double amr_threshold;
+    int amr_rebalance;
+
+    //Checkpoint variables
+    int checkpoint_steps;
+    double checkpoint_time;
+    int checkpoint_keep;
+
+    //Output variables
+    bool async_output;
+    bool output_float;
+    int compression_level;
+    string output_fields;
+    int output_aggregators;
+    bool lossy_output;
+    bool lossy_checkpoint;
+    double lossy_abstol;
+    double lossy_reltol;
+    int raster_nr;
+    int raster_nz;
+    int full_output;
+    int diagnostics_steps;
+    int timer_steps;
+    bool trace;
+    bool hardware_counters;
+
     //Re-Initialization variables
     bool restart;
     double t_init;
 };
 
 
+//Bilinear interpolation of the liquid equation of state in (T,S)
+class Density_Table{
+    public:
+        //Tabulate the liquid density in a points x points grid
+        Density_Table(int points);
+
+        //Maximum relative error against the analytic expression
+        double Error() const { return error; }
+
+        //Relative density of the liquid (without the phase factor)
+        double Eval(const double T, const double S) const;
+    protected:
+        int points;
+        double T_min, T_max, T_step_inv;
+        double S_min, S_max, S_step_inv;
+        Vector values;
+        double error;
+};
+
+//BoomerAMG that keeps its hierarchy while the operator changes slightly,
+//a full setup is done again when the solver iterations grow above
+//threshold times the iterations after the last full setup
+class Reusable_BoomerAMG : public HypreBoomerAMG{
+    public:
+        Reusable_BoomerAMG();
+
+        //Enable the reuse of the hierarchy (threshold <= 0 disables it)
+        void SetReuse(double threshold);
+
+        //Update the operator, keeping the hierarchy if possible
+        virtual void SetOperator(const Operator &op);
+        virtual HYPRE_PtrToParSolverFcn SetupFcn() const;
+
+        //Report the iterations of the last solve
+        void Monitor(int iterations);
+
+        //Force a full setup with the next operator
+        void Invalidate();
+
+        //Statistics of the setups
+        int GetFullSetups() const;
+        int GetReusedSetups() const;
+    protected:
+        void SetSmoother();
+
+        double threshold;
+        bool reuse, stale;
+        int base_iterations;
+        HYPRE_BigInt setup_rows;
+        int full_setups, reused_setups;
+};
+
+//Solves of a linear system (the residual is the largest final
+//relative residual)
+struct Linear_Statistics{
+    int solves;
+    int iterations;
+    double residual;
+};
+
 //Solver for the temperature and salinity field
 class Transport_Operator : public TimeDependentOperator{
     public:
@@ -126,16 +245,42 @@ class Transport_Operator : public TimeDependentOperator{
         //Update of the solver on each iteration
         void SetParameters(const BlockVector &X, const Vector &rVelocity);
 
+        //Initial conditions on the current mesh
+        void SetInitialConditions(BlockVector &X);
+
+        //Adaptation to the updated spaces after a change of the mesh
+        void Update(const Array<int> &block_offsets_H1);
+
         //Time-evolving functions
         virtual void Mult(const Vector &X, Vector &dX_dt) const;
         virtual int SUNImplicitSetup(const Vector &X, const Vector &RHS, int j_update, int *j_status, double scaled_dt);
 	    virtual int SUNImplicitSolve(const Vector &X, Vector &X_new, double tol);
 
+        //Maximum heap allocations inside a single callback
+        long GetCallbackAllocations() const;
+
+        //Statistics of the Jacobian setups
+        int GetSetups() const;
+        int GetSkippedSetups() const;
+        int GetAMGSetups() const;
+        int GetAMGReusedSetups() const;
+
+        //Statistics of the linear solves since the last reset (M0, M1, T0, T1)
+        const Linear_Statistics *GetLinearStatistics() const { return linear_statistics; }
+        void ResetLinearStatistics();
+
         virtual ~Transport_Operator();
     protected:
         //All 0-variables are related to temperature
         //All 1-variables are related to salinity
 
+        //Operators that do not depend on (T,S)
+        void AssembleConstant();
+
+        //Matrix-free assembly of the operators
+        void SetPartialAssembly();
+        void SetPartialAssemblyJacobian(double scaled_dt);
+
         //Global parameters
         Config config;
 
@@ -178,11 +323,43 @@ class Transport_Operator : public TimeDependentOperator{
         HypreParVector B0_dt, B1_dt;
         mutable HypreParVector Z0, Z1;
 
+        //Views of the blocks of the ARKODE vectors (no copies)
+        mutable HypreParVector X0_view, X1_view;
+        mutable HypreParVector Y0_view, Y1_view;
+        mutable long callback_allocations;
+        mutable Linear_Statistics linear_statistics[4];
+
+        //Jacobian reuse (T is kept while the coefficients and dt do not change)
+        bool jacobian_outdated;
+        int jacobian_setups, jacobian_skipped;
+
         //Solver objects
         HyprePCG M0_solver, M1_solver;
         HyprePCG T0_solver, T1_solver;
-        HypreBoomerAMG M0_prec, M1_prec;
-        HypreBoomerAMG T0_prec, T1_prec;
+        Reusable_BoomerAMG M0_prec, T0_prec, T1_prec;
+        HypreBoomerAMG M1_prec;
+
+        //Partial assembly objects (K = diffusion + convection)
+        Array<int> ess_tdof_none;
+        ParBilinearForm *m0_pa, *m1_pa;
+        ParBilinearForm *k0_pa, *k1_pa;
+        ParBilinearForm *c0_pa, *c1_pa;
+        OperatorHandle M0_pa, M1_pa;
+        OperatorHandle M0_o_pa, M1_o_pa;
+        OperatorHandle K0_d_pa, K1_d_pa;
+        OperatorHandle K0_c_pa, K1_c_pa;
+        SumOperator *K0_pa, *K1_pa;
+        ConstrainedOperator *T0_pa, *T1_pa;
+        double setup_dt;
+        Vector M0_diag, M1_diag;
+        Vector K0_diag, K1_diag;
+        Vector T0_diag, T1_diag;
+
+        //Partial assembly solver objects
+        CGSolver M0_pa_solver, M1_pa_solver;
+        GMRESSolver T0_pa_solver, T1_pa_solver;
+        OperatorJacobiSmoother *M0_pa_prec, *M1_pa_prec;
+        OperatorJacobiSmoother *T0_pa_prec, *T1_pa_prec;
 };
 
 //Solver for the velocity field
@@ -194,9 +371,28 @@ class Flow_Operator{
         //Update of the solver on each iteration
         void SetParameters(const BlockVector &X);
 
+        //Adaptation to the updated spaces after a change of the mesh
+        void Update(const Array<int> &block_offsets_H1);
+
         //Solution of the current system
         void Solve(BlockVector &Y, Vector &Velocity, Vector &rVelocity);
 
+        //Velocity field from the stream function
+        void UpdateVelocity(const BlockVector &Y, Vector &Velocity, Vector &rVelocity);
+
+        //Statistics of the iterative solver
+        int GetSolves() const;
+        int GetIterations() const;
+
+        //Statistics of the solves since the last reset
+        const Linear_Statistics &GetLinearStatistics() const { return linear_statistics; }
+        void ResetLinearStatistics();
+
+        //Fields of the state given to SetParameters and its velocity
+        const ParGridFunction &GetTemperature() const { return temperature; }
+        const ParGridFunction &GetSalinity() const { return salinity; }
+        const ParGridFunction &GetVelocity() const { return velocity; }
+
         ~Flow_Operator();
     protected:
         //All 0-variables are related to vorticity
@@ -227,6 +423,9 @@ class Flow_Operator{
         ParGridFunction density_dr;
         ParGridFunction impermeability;
 
+        //Contribution of the eliminated A10 columns to b1
+        Vector b1_boundary;
+
         //System objects
         BlockVector B;
         HypreParVector *B0, *B1;
@@ -235,6 +434,52 @@ class Flow_Operator{
         HypreParMatrix *A01;
         HypreParMatrix *A10;
         HypreParMatrix *A11;
+
+        //Tabulated equation of state (NULL if analytic)
+        Density_Table *density_table;
+
+        //Boundary values and forms that do not depend on (T,S)
+        void AssembleConstant();
+
+        //Build H and its SuperLU copy, or overwrite only their A11 entries
+        //(false if the pattern of A11 changed)
+        void AssembleDirect();
+        bool RefreshDirect();
+
+        //Solver objects
+        HypreParMatrix *H;
+        SuperLURowLocMatrix *H_superlu;
+        SuperLUSolver *superlu_solver;
+        bool factorized;
+
+        //Positions of the entries of A11 in H (diagonal part, or -1-p in
+        //the off-diagonal part) and in the values of the SuperLU matrix,
+        //paired with the entry of A11 (k in its diagonal part, -1-k in its
+        //off-diagonal part), and the values of the SuperLU matrix before
+        //SuperLU scales them
+        std::vector<std::pair<int, int>> a11_H, a11_superlu;
+        std::vector<double> H_values;
+        int a11_diag_size, a11_offd_size;
+
+        //Iterative solver objects
+        //
+        //   P = [ M_d    0 ]^-1
+        //       [ C^t    S ]
+        //
+        //with S = D - C^t M_d^-1 C, where only D changes between steps
+        BlockOperator *H_block;
+        BlockLowerTriangularPreconditioner *H_prec;
+        HypreSmoother A00_prec;
+        HypreParMatrix *A10_A01;
+        HypreParMatrix *S;
+        Reusable_BoomerAMG S_amg;
+        ScaledOperator *S_prec;
+        FGMRESSolver krylov;
+        int krylov_solves, krylov_iterations;
+
+        //True residual of the solution
+        Vector residual;
+        Linear_Statistics linear_statistics;
       
         //Coefficients
         FunctionCoefficient coeff_r;
@@ -253,6 +498,219 @@ class Flow_Operator{
         ParDiscreteLinearOperator gradient;
 };
 
+//Staging copy of the meshes and fields of a group of processors,
+//each processor keeps a serial copy of its local mesh and only the
+//writer of the group holds the pieces
+struct Output_Slot{
+    Mesh *mesh;
+    Mesh *local;
+    FiniteElementCollection *fec_H1, *fec_ND;
+    FiniteElementSpace *local_H1, *local_ND;
+    std::vector<GridFunction*> local_fields;
+    Vector local_values;
+    long sequence;
+    std::vector<Mesh*> pieces;
+    std::vector<FiniteElementSpace*> fespaces;
+    std::vector<GridFunction*> piece_fields;
+    std::vector<GridFunction*> fields;
+    std::vector<int> counts, displs;
+    Vector values;
+};
+
+//ParaView output, the fields of a group of processors are joined
+//in one file written by a background thread or each processor
+//prints its own fields directly. The joined fields can also be
+//stored in a compressed archive instead
+class Output_Writer{
+    public:
+        //Initialization of the output
+        Output_Writer(Config config, ParMesh *pmesh, const string &folder);
+
+        //Register a field of the program
+        void RegisterField(const string &name, ParGridFunction *field);
+
+        //Print the fields, in the background if possible
+        void Save(int cycle, double time);
+
+        //Wait for the I/O thread
+        void Finish();
+
+        //If the field is printed
+        bool Requested(const string &name) const;
+
+        //Printed snapshots, files, bytes and time of writing of
+        //this processor (only valid after Finish)
+        int GetSnapshots() const { return snapshots; }
+        long GetFiles() const { return files; }
+        long GetBytes() const { return bytes; }
+        double GetWriteTime() const { return write_time; }
+
+        ~Output_Writer();
+    protected:
+        void Stage(Output_Slot &slot);
+        void Release(Output_Slot &slot);
+        void Gather(Output_Slot &slot);
+        void Write();
+        void Archive(int index, int cycle, double time);
+        void Measure(int cycle);
+
+        Config config;
+        ParMesh *pmesh;
+        bool direct;
+        bool async;
+
+        std::vector<string> names;
+        std::vector<ParGridFunction*> fields;
+
+        MPI_Comm group_comm, writer_comm;
+        int group, group_rank, group_size;
+        int archive_mesh;
+        long archive_sequence;
+        Array<int> dofs, local_dofs;
+        Vector element_values;
+
+        ParaViewDataCollection paraview;
+        Output_Slot slots[2];
+        int current;
+        std::thread writer;
+
+        int snapshots;
+        long files;
+        long bytes;
+        double write_time;
+};
+
+//Fields interpolated on a Cartesian (r,z) grid and printed by
+//the master as a compact VTK image
+class Raster_Writer{
+    public:
+        //Initialization of the grid
+        Raster_Writer(Config config, ParMesh *pmesh);
+
+        //Register a field of the program
+        void RegisterField(const string &name, ParGridFunction *field);
+
+        //Interpolate the fields and print them
+        void Save(int cycle, double time);
+
+        //Printed images and time spent on them
+        int GetSaves() const { return saves; }
+        double GetTime() const { return time_spent; }
+    protected:
+        void Locate();
+
+        Config config;
+        ParMesh *pmesh;
+        int nr, nz;
+
+        std::vector<string> names;
+        std::vector<ParGridFunction*> fields;
+        std::vector<int> components;
+
+        long sequence;
+        Array<int> elements;
+        Array<IntegrationPoint> ips;
+        std::vector<int> found;
+        Vector local, global;
+
+        int saves;
+        double time_spent;
+};
+
+//Phases of the program measured by the timers
+enum Region{
+    REGION_ARKODE,
+    REGION_MATERIALS,
+    REGION_TRANSPORT_ASSEMBLY,
+    REGION_AMG_SETUP,
+    REGION_TRANSPORT_SOLVE,
+    REGION_FLOW_ASSEMBLY,
+    REGION_FLOW_SOLVE,
+    REGION_VELOCITY,
+    REGION_AMR,
+    REGION_OUTPUT,
+    REGION_DIAGNOSTICS,
+    REGION_CHECKPOINT,
+    REGION_COUNT
+};
+
+//Hardware counters of the regions
+enum Counter{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    HARDWARE_COUNTERS
+};
+
+//Scoped timer of a region, the time (and hardware counts) of
+//nested timers is only counted in the innermost region
+class Region_Timer{
+    public:
+        Region_Timer(Region region);
+        ~Region_Timer();
+
+    protected:
+        Region region;
+        double start;
+        double nested;
+        double counts[HARDWARE_COUNTERS];
+        double nested_counts[HARDWARE_COUNTERS];
+        Region_Timer *parent;
+};
+
+//Hardware counters of the current thread (only read if enabled)
+extern thread_local bool counters_enabled;
+extern const char *CounterName(int counter);
+extern int StartCounters();                     //Open the counters, returns the available ones (bit mask)
+extern void ReadCounters(double *values);       //Current values of the counters
+extern void StopCounters();
+
+//Timeline of the execution (only recorded if enabled)
+extern bool trace_enabled;
+extern void TraceEvent(const char *name, double start, double end);    //Record a span of the current thread
+extern void StartTrace();                                              //Enable the tracing on all the ranks
+extern void WriteTrace(const string &file);                            //Gather the spans in the master
+
+//Scoped span of the timeline (not measured by the timers)
+class Trace_Span{
+    public:
+        Trace_Span(const char *name): name(name), start(trace_enabled ? MPI_Wtime() : 0.) {}
+        ~Trace_Span(){ if (trace_enabled) TraceEvent(name, start, MPI_Wtime()); }
+
+    protected:
+        const char *name;
+        double start;
+};
+
+//Time series of the fields at fixed points, sampled on every step
+class Probe_Writer{
+    public:
+        //Read the probes and create their files
+        Probe_Writer(Config config, ParMesh *pmesh);
+
+        //Evaluate the probes owned by this processor
+        void Sample(double time, const ParGridFunction &temperature, const ParGridFunction &salinity, const ParGridFunction &velocity);
+
+        //Append the buffered samples to the files
+        void Flush();
+
+        ~Probe_Writer();
+    protected:
+        void Locate();
+        void Flush(int index);
+
+        Config config;
+        ParMesh *pmesh;
+
+        std::vector<string> names;
+        std::vector<double> positions;
+        std::vector<string> buffers;
+
+        long sequence;
+        Array<int> elements;
+        Array<IntegrationPoint> ips;
+};
+
 //Main class of the program
 class Artic_sea{
     public:
@@ -269,13 +727,38 @@ class Artic_sea{
 
         //Initialize the solvers and the variables
         void assemble_system();
+        void set_ode_solver();
+
+        //Adapt the mesh to the phase interface
+        void refine_mesh(bool initial);
+        void mark_interface(Vector &indicator, Array<int> &marked);
+        void update_fields();
+        void resize_ode_solver();
 
         //Evolve the simulation one time step 
         void time_step();
+        void print_dense();
+        void compute_diagnostics();
+        void print_timers();
+        void start_telemetry();
+        void count_telemetry();
+        void record_telemetry(const string &progress);
+        void flush_telemetry();
+        void print_fields(double time, const BlockVector &X_vis, const BlockVector &Y_vis, const Vector &Velocity_vis, const Vector &rVelocity_vis);
 
         //Print the final results
         void output_results();
 
+        //Binary checkpoint (independent of the number of processors,
+        //except for adapted meshes)
+        void save_checkpoint();
+        Mesh *load_checkpoint();
+        void load_checkpoint_fields(Mesh *serial_mesh, const int *partitioning);
+        void start_checkpoints();
+        bool checkpoint_due();
+        void finish_checkpoints();
+        void commit_checkpoints();
+
         //Global parameters
         Config config;
 
@@ -286,6 +769,20 @@ class Artic_sea{
         bool last;
         int vis_iteration;
         int vis_steps;
+        double vis_time_next;
+        double vis_time_printed;
+        double diagnostics_time, diagnostics_salt, diagnostics_flux;
+        MPI_Op diagnostics_operation;
+        int timer_prints;
+        int counters_available;
+
+        //Per-step telemetry of the solvers (buffered by the master)
+        double telemetry_start;
+        double telemetry_flush;
+        long telemetry_counters[6];
+        Linear_Statistics telemetry_linear[5];
+        string telemetry_buffer;
+        string progress_buffer;
         int vis_print;
         double total_time;
 
@@ -303,6 +800,8 @@ class Artic_sea{
         int dim;
         double h_min;
         int serial_refinements;
+        int amr_base_depth;
+        int adaptations;
         HYPRE_Int size_H1;
         HYPRE_Int size_ND;
 
@@ -320,6 +819,12 @@ class Artic_sea{
         HypreParVector *Velocity;
         HypreParVector *rVelocity;
 
+        //State interpolated at the dense outputs
+        BlockVector X_dense;
+        BlockVector Y_dense;
+        Vector Velocity_dense;
+        Vector rVelocity_dense;
+
         //Solvers
         Transport_Operator *transport_oper;
         Flow_Operator *flow_oper;
@@ -329,7 +834,25 @@ class Artic_sea{
         ARKStepSolver *arkode;
 
         //Output gate
-        ParaViewDataCollection *paraview_out;
+        Output_Writer *paraview_out;
+        Raster_Writer *raster_out;
+        Probe_Writer *probes;
+
+        //Checkpoint data read on restart
+        string checkpoint_buffer;
+        size_t checkpoint_position;
+        int checkpoint_format;
+        double dt_restart;
+
+        //Periodic checkpoints (written by a background thread)
+        std::thread checkpoint_writer;
+        std::deque<string> checkpoint_files;
+        string checkpoint_pending;
+        int checkpoints;
+        double checkpoint_clock;
+        double checkpoint_overhead;
+        double checkpoint_write_time;
+        double loop_time;
 };
 
 //Constants associated with physical properties
@@ -354,6 +877,21 @@ extern double NucleationSalinity;       //Salinity of the nucleation point
                                             
 extern double InflowFlux;                        //Flux at the inflow boundary divided by 2PI
 
+//Heap allocations done through operator new (only counted when
+//compiled with COUNT_ALLOCATIONS)
+extern long AllocationCount();
+extern bool AllocationsCounted();
+
+//Accumulated time of the regions (in this processor and over all of them)
+extern const char *RegionName(int region);
+extern double RegionTime(int region);
+extern void RegionStatistics(double *minimum, double *maximum, double *average);
+extern void RegionCounters(double *total);      //Sum over the processors (region-major)
+
+//Error-bounded lossy codec of the values of a field
+extern void CompressField(const double *values, int size, double abstol, double reltol, string &buffer);   //Append the values (error <= max(abstol, reltol*range))
+extern void DecompressField(const string &buffer, size_t &position, Vector &values);                       //Reconstruct the values, advancing the position
+
 //Usefull position functions
 extern double r_f(const Vector &x);                     //Function for r
 extern double r_inv_f(const Vector &x);                 //Function for 1/r
@@ -370,3 +908,18 @@ extern double HeatDiffusivity(const double T, const double S);          //Coeffi
 extern double SaltDiffusivity(const double T, const double S);          //Coefficient for the diffusion term in the salinity equation
 extern double Impermeability(const double T, const double S);           //Inverse of the brinkman penalization permeability
 extern double Density(const double T, const double S);                  //Relative density of the fluid
+extern double LiquidDensity(const double T, const double S);            //Relative density of the liquid phase
+
+//Output arrays for the batched evaluation of the properties (NULL skips the field)
+struct Property_Fields{
+    double *phase = NULL;               //Phase indicator
+    double *heat_inertia = NULL;        //Coefficient for the mass term in the temperature equation
+    double *heat_diffusivity = NULL;    //Coefficient for the diffusion term in the temperature equation
+    double *salt_diffusivity = NULL;    //Coefficient for the diffusion term in the salinity equation
+    double *impermeability = NULL;      //Inverse of the brinkman penalization permeability
+    double *density = NULL;             //Relative density of the fluid
+    double *temperature = NULL;         //Temperature shifted by the fusion point (can be the input T)
+
+    const Density_Table *density_table = NULL;  //Tabulated equation of state used for the density (if any)
+};
+extern void MaterialProperties(const int size, const double *T, const double *S, const Property_Fields &fields);   //All the properties with one tanh per node
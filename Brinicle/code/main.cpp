@@ -35,6 +35,15 @@ int main(int argc, char *argv[]){
     int rescale = 0;
     int nEpsilon = 0;
     int restart = 0;
+    int partial_assembly = 0;
+    int async_output = 0;
+    int output_float = 0;
+    int lossy_output = 0;
+    int lossy_checkpoint = 0;
+    int trace = 0;
+    int hardware_counters = 0;
+    int dense_flow = 0;
+    const char *output_fields = "Temperature,Salinity,Phase,Vorticity,Stream,Velocity,rVelocity";
 
     OptionsParser args(argc, argv);
     args.AddOption(&mesh_file, "-m", "--mesh",
@@ -58,6 +67,10 @@ int main(int argc, char *argv[]){
                    "Final time.");
     args.AddOption(&config.vis_steps_max, "-v_s", "--visualization_steps",
                    "Visualize every n-th timestep.");
+    args.AddOption(&config.vis_time, "-v_t", "--visualization_time",
+                   "Visualize every time interval (0 uses the visualization steps).");
+    args.AddOption(&dense_flow, "-dense_f", "--dense_flow",
+                   "If the flow is solved again at the interpolated outputs (1) or the one of the step is kept (0).");
     args.AddOption(&rescale, "-rc", "--rescale",
                    "If the simulation rescales the stream (1) or not (0).");
 
@@ -97,6 +110,76 @@ int main(int argc, char *argv[]){
     args.AddOption(&NucleationSalinity, "-Sn", "--Phi_n",
                    "Nucleation salinity.");
 
+    args.AddOption(&config.superlu_reuse, "-slu_r", "--superlu_reuse",
+                   "Reuse of the SuperLU factorization between steps (0 none, 1 SamePattern, 2 SamePattern_SameRowPerm).");
+    args.AddOption(&config.flow_solver, "-flow", "--flow_solver",
+                   "Solver of the flow system (0 SuperLU, 1 block preconditioned FGMRES).");
+    args.AddOption(&config.reltol_flow, "-reltol_f", "--tolrelativeFlow",
+                   "Relative tolerance of Flow.");
+    args.AddOption(&config.iter_flow, "-iter_f", "--iterationsFlow",
+                   "Iterations of Flow.");
+
+    args.AddOption(&partial_assembly, "-pa", "--partial_assembly",
+                   "If the transport operators are partially assembled (1) or not (0).");
+    args.AddOption(&config.jacobian_ratio, "-j_r", "--jacobian_ratio",
+                   "Maximum relative change of dt to reuse the transport Jacobian (0 never reuses).");
+    args.AddOption(&config.amg_reuse, "-amg_r", "--amg_reuse",
+                   "Iteration growth that triggers a new AMG hierarchy (0 always builds a new one).");
+
+    args.AddOption(&config.table_points, "-table_n", "--table_points",
+                   "Points per direction of the tabulated equation of state (0 analytic).");
+    args.AddOption(&config.table_tol, "-table_tol", "--table_tolerance",
+                   "Maximum relative error allowed for the tabulated equation of state.");
+
+    args.AddOption(&config.amr_steps, "-amr", "--amr_steps",
+                   "Adapt the mesh every n-th timestep (0 uniform mesh).");
+    args.AddOption(&config.amr_levels, "-amr_l", "--amr_levels",
+                   "Levels of adaptive refinement over the uniform mesh.");
+    args.AddOption(&config.amr_threshold, "-amr_t", "--amr_threshold",
+                   "Phase range inside an element that triggers its refinement.");
+    args.AddOption(&config.amr_rebalance, "-amr_b", "--amr_rebalance",
+                   "Rebalance the mesh every n-th adaptation (0 never).");
+
+    args.AddOption(&config.checkpoint_steps, "-ckpt", "--checkpoint_steps",
+                   "Write a checkpoint every n-th timestep (0 never).");
+    args.AddOption(&config.checkpoint_time, "-ckpt_t", "--checkpoint_time",
+                   "Write a checkpoint every t seconds of wall time (0 never).");
+    args.AddOption(&config.checkpoint_keep, "-ckpt_k", "--checkpoint_keep",
+                   "Number of checkpoints kept.");
+
+    args.AddOption(&async_output, "-async", "--async_output",
+                   "If the visualization is written by a background thread (1) or not (0).");
+    args.AddOption(&output_float, "-float", "--output_float",
+                   "If the visualization is written in single (1) or double (0) precision.");
+    args.AddOption(&config.compression_level, "-zlib", "--compression_level",
+                   "Compression level of the visualization (0-9).");
+    args.AddOption(&output_fields, "-fields", "--output_fields",
+                   "Comma separated list of the printed fields.");
+    args.AddOption(&config.output_aggregators, "-aggr", "--output_aggregators",
+                   "Number of processors that write the visualization (0 for all).");
+    args.AddOption(&lossy_output, "-lossy", "--lossy_output",
+                   "If the visualization is stored in the compressed archive (1) or not (0).");
+    args.AddOption(&lossy_checkpoint, "-lossy_c", "--lossy_checkpoint",
+                   "If the checkpoints are compressed (1) or not (0).");
+    args.AddOption(&config.lossy_abstol, "-lossy_abs", "--lossy_abstol",
+                   "Absolute error bound of the compressed fields.");
+    args.AddOption(&config.lossy_reltol, "-lossy_rel", "--lossy_reltol",
+                   "Error bound of the compressed fields relative to their range.");
+    args.AddOption(&config.raster_nr, "-raster_r", "--raster_nr",
+                   "Points in r of the raster output (0 for none).");
+    args.AddOption(&config.raster_nz, "-raster_z", "--raster_nz",
+                   "Points in z of the raster output.");
+    args.AddOption(&config.full_output, "-full", "--full_output",
+                   "Print the full output every n-th visualization step.");
+    args.AddOption(&config.diagnostics_steps, "-diag", "--diagnostics_steps",
+                   "Compute the diagnostics every n-th timestep (0 for none).");
+    args.AddOption(&config.timer_steps, "-timer", "--timer_steps",
+                   "Print the timers every n-th timestep (0 only at the end).");
+    args.AddOption(&trace, "-trace", "--trace",
+                   "Record the timeline of the execution (1) or not (0).");
+    args.AddOption(&hardware_counters, "-hw", "--hardware_counters",
+                   "Read the hardware counters in the timers (1) or not (0).");
+
     args.AddOption(&restart, "-r", "--restart",
                    "If the simulation restarts (1) or not (0).");
     args.AddOption(&config.t_init, "-t_i", "--t_init",
@@ -115,6 +198,15 @@ int main(int argc, char *argv[]){
         InflowFlux = 0.25*InflowVelocity*pow(RIn, 2);
 
         config.rescale = (rescale == 1);
+        config.partial_assembly = (partial_assembly == 1);
+        config.async_output = (async_output == 1);
+        config.output_float = (output_float == 1);
+        config.output_fields = output_fields;
+        config.lossy_output = (lossy_output == 1);
+        config.lossy_checkpoint = (lossy_checkpoint == 1);
+        config.trace = (trace == 1);
+        config.hardware_counters = (hardware_counters == 1);
+        config.dense_flow = (dense_flow == 1);
 
         Epsilon = pow(10, -nEpsilon); 
         EpsilonInv = pow(10, nEpsilon); 
@@ -4,32 +4,80 @@
 void Artic_sea::output_results(){
 
     //Save final state
-    std::ofstream out;
-    std::ostringstream oss;
-    oss << std::setw(10) << std::setfill('0') << config.pid;
-    std::string n_mesh = "results/restart/pmesh_"+oss.str()+".msh";
-    std::string n_temperature = "results/restart/temperature_"+oss.str()+".gf";
-    std::string n_salinity = "results/restart/salinity_"+oss.str()+".gf";
+    paraview_out->Finish();
+    save_checkpoint();
+    commit_checkpoints();
 
-    out.open(n_mesh.c_str(),std::ios::out);
-    pmesh->ParPrint(out);
-    out.close();
-
-    out.open(n_temperature.c_str(),std::ios::out);
-    temperature->Save(out);
-    out.close();
-
-    out.open(n_salinity.c_str(),std::ios::out);
-    salinity->Save(out);
-    out.close();
+    //Records of the last steps (a signal may stop the run before
+    //the periodic flush)
+    flush_telemetry();
 
     //Update the initial time for future simulations
     if (config.master){
+        std::ofstream out;
         out.open("settings/parameters.txt", std::ios::app);
         out << t << "       #Initial_time\n";
         out.close();
     }
 
+    //Average iterations of the flow solver
+    double flow_iterations = flow_oper->GetIterations()/max(1., (double)flow_oper->GetSolves());
+
+    //Heap allocations inside the ARKODE callbacks
+    long local_allocations = transport_oper->GetCallbackAllocations(), callback_allocations;
+    MPI_Allreduce(&local_allocations, &callback_allocations, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+
+    //Files, size and time of writing of the visualization
+    long local_output[2] = {paraview_out->GetFiles(), paraview_out->GetBytes()}, output[2];
+    MPI_Allreduce(local_output, output, 2, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    double local_write_time = paraview_out->GetWriteTime(), write_time;
+    MPI_Allreduce(&local_write_time, &write_time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    int snapshots = max(1, paraview_out->GetSnapshots());
+    double snapshot_files = output[0]/(double)snapshots;
+    double snapshot_size = output[1]/(1048576.*snapshots);
+    double snapshot_time = write_time/snapshots;
+
+    //Files of the output without aggregation (one piece per processor
+    //and the header of the cycle), to compare with the actual ones
+    int rank_files = config.nproc + 1;
+    double raster_time = raster_out ? raster_out->GetTime()/max(1, raster_out->GetSaves()) : 0.;
+
+    //Time of the phases over the processors (imbalance is max/avg)
+    double timer_min[REGION_COUNT], timer_max[REGION_COUNT], timer_avg[REGION_COUNT];
+    RegionStatistics(timer_min, timer_max, timer_avg);
+    std::ostringstream timers;
+    timers << "Timers (min/avg/max, imbalance):\n";
+    for (int ii = 0; ii < REGION_COUNT; ii++)
+        timers << "    " << left << setw(24) << RegionName(ii)
+               << timer_min[ii] << " / " << timer_avg[ii] << " / " << timer_max[ii] << " s, "
+               << timer_max[ii]/max(timer_avg[ii], 1E-12) << "\n";
+
+    //Hardware counters of the phases (the memory traffic is estimated
+    //as 64 bytes per cache miss)
+    if (config.hardware_counters){
+        double counts[REGION_COUNT*HARDWARE_COUNTERS];
+        RegionCounters(counts);
+        bool ipc = (counters_available & 3) == 3;
+        bool traffic = (counters_available & 6) == 6;
+        timers << "Hardware counters (IPC, cache misses/kinstr, bytes/instr):";
+        if (!ipc && !traffic)
+            timers << " not available";
+        timers << "\n";
+        for (int ii = 0; ii < REGION_COUNT && (ipc || traffic); ii++){
+            double *count = counts + ii*HARDWARE_COUNTERS;
+            double instructions = max(count[COUNTER_INSTRUCTIONS], 1.);
+            timers << "    " << left << setw(24) << RegionName(ii);
+            if (ipc) timers << count[COUNTER_INSTRUCTIONS]/max(count[COUNTER_CYCLES], 1.);
+            else timers << "-";
+            if (traffic) timers << ", " << 1000*count[COUNTER_CACHE_MISSES]/instructions << ", " << 64*count[COUNTER_CACHE_MISSES]/instructions;
+            else timers << ", -, -";
+            timers << "\n";
+        }
+    }
+
+    //Time spent by the time loop in checkpoints
+    double checkpoint_percentage = 100*checkpoint_overhead/max(loop_time, 1E-12);
+
     //Print general information of the program
     if (config.master){
         cout << "\n\nSize (H1): " << size_H1 << "\n"
@@ -40,7 +88,18 @@ void Artic_sea::output_results(){
              << "Total refinements: " << config.refinements << "\n"
              << "Total iterations: " << iteration << "\n"
              << "Total printing: " << vis_print << "\n"
-             << "Total execution time: " << total_time << " s" << "\n";
+             << "Output per snapshot: " << snapshot_files << " files (" << rank_files << " without aggregation), " << snapshot_size << " MB, " << snapshot_time << " s\n";
+        if (raster_out)
+            cout << "Raster output per snapshot: " << raster_time << " s\n";
+        if (config.flow_solver != 0)
+            cout << "Flow iterations (average): " << flow_iterations << "\n";
+        cout << "Checkpoints: " << checkpoints << " (" << checkpoint_percentage << " % of the time loop, " << checkpoint_write_time << " s in background)\n";
+        cout << "AMG setups (reused/total): " << transport_oper->GetAMGReusedSetups() << "/" << transport_oper->GetAMGSetups() << "\n";
+        cout << "Jacobian setups (skipped/built): " << transport_oper->GetSkippedSetups() << "/" << transport_oper->GetSetups() << "\n";
+        if (AllocationsCounted())
+            cout << "Callback allocations (max, C++ only): " << callback_allocations << "\n";
+        cout << timers.str();
+        cout << "Total execution time: " << total_time << " s" << "\n";
 
         std::ofstream out;
         out.open("results/state.txt", std::ios::trunc);
@@ -52,7 +111,21 @@ void Artic_sea::output_results(){
             << "Total refinements: " << config.refinements << "\n"
             << "Total iterations: " << iteration << "\n"
             << "Total printing: " << vis_print << "\n"
-            << "Total execution time: " << total_time << " s" << "\n";
+            << "Output per snapshot: " << snapshot_files << " files (" << rank_files << " without aggregation), " << snapshot_size << " MB, " << snapshot_time << " s\n";
+        if (raster_out)
+            out << "Raster output per snapshot: " << raster_time << " s\n";
+        if (config.flow_solver != 0)
+            out << "Flow iterations (average): " << flow_iterations << "\n";
+        out << "Checkpoints: " << checkpoints << " (" << checkpoint_percentage << " % of the time loop, " << checkpoint_write_time << " s in background)\n";
+        out << "AMG setups (reused/total): " << transport_oper->GetAMGReusedSetups() << "/" << transport_oper->GetAMGSetups() << "\n";
+        out << "Jacobian setups (skipped/built): " << transport_oper->GetSkippedSetups() << "/" << transport_oper->GetSetups() << "\n";
+        if (AllocationsCounted())
+            out << "Callback allocations (max, C++ only): " << callback_allocations << "\n";
+        out << timers.str();
+        out << "Total execution time: " << total_time << " s" << "\n";
         out.close();
     }
+
+    //Timeline of all the ranks
+    if (config.trace) WriteTrace("results/trace.json");
 }
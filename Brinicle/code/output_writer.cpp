@@ -0,0 +1,400 @@
+#include "header.h"
+#include <chrono>
+#include <cstring>
+
+/****
+ * Compressed archive of the visualization (results/archive)
+ *
+ * mesh_MMMMMM_GGGGGG.bin (written by each group for each mesh M)
+ * int       pieces
+ * long      bytes of the mesh (MFEM text format) + mesh, for each piece
+ *
+ * cycle_CCCCCC_GGGGGG.bin
+ * char[8]   "BRNARCHV"
+ * int       version, order, cycle, pieces, fields, mesh (version 2)
+ * double    time
+ * int       nedelec?, bytes of the name + name, for each field
+ * block     compressed values (CompressField), for each piece and field
+ ****/
+static const char archive_magic[8] = {'B','R','N','A','R','C','H','V'};
+static const int archive_version = 2;
+static const string archive_folder = "results/archive/";
+
+//Initialization of the output, the processors are split in contiguous
+//groups and the first processor of each group writes the piece of
+//the whole group (one file per group instead of one per processor)
+Output_Writer::Output_Writer(Config config, ParMesh *pmesh, const string &folder):
+    config(config),
+    pmesh(pmesh),
+    direct(!config.async_output && config.output_aggregators <= 0 && !config.lossy_output),
+    async(config.async_output && !direct),
+    paraview(folder, direct ? pmesh : NULL),
+    current(0),
+    snapshots(0),
+    files(0),
+    bytes(0),
+    write_time(0.)
+{
+    paraview.SetDataFormat(config.output_float ? VTKFormat::BINARY32 : VTKFormat::BINARY);
+    paraview.SetLevelsOfDetail(config.order);
+#ifdef MFEM_USE_ZLIB
+    paraview.SetCompressionLevel(config.compression_level);
+#else
+    MFEM_VERIFY(config.compression_level == 0, "MFEM was compiled without zlib, the output can not be compressed.");
+#endif
+
+    //Groups of processors that share a file
+    int aggregators = (config.output_aggregators > 0) ? min(config.output_aggregators, config.nproc) : config.nproc;
+    group = (int)(((long)config.pid*aggregators)/config.nproc);
+    MPI_Comm_split(MPI_COMM_WORLD, group, config.pid, &group_comm);
+    MPI_Comm_rank(group_comm, &group_rank);
+    MPI_Comm_size(group_comm, &group_size);
+    MPI_Comm_split(MPI_COMM_WORLD, (group_rank == 0) ? 0 : MPI_UNDEFINED, config.pid, &writer_comm);
+
+    for (int ii = 0; ii < 2; ii++){
+        slots[ii].mesh = NULL;
+        slots[ii].local = NULL;
+        slots[ii].local_H1 = NULL;
+        slots[ii].local_ND = NULL;
+        slots[ii].fec_H1 = NULL;
+        slots[ii].fec_ND = NULL;
+        slots[ii].sequence = -1;
+    }
+
+    archive_mesh = -1;
+    archive_sequence = -1;
+}
+
+//If the field is in the comma separated list of the output
+bool Output_Writer::Requested(const string &name) const{
+    string list = "," + config.output_fields + ",";
+    return list.find("," + name + ",") != string::npos;
+}
+
+//Register a field of the program (only if it is requested)
+void Output_Writer::RegisterField(const string &name, ParGridFunction *field){
+    if (!Requested(name)) return;
+    names.push_back(name);
+    fields.push_back(field);
+    if (direct) paraview.RegisterField(name, field);
+}
+
+//Print the fields, in the background if possible
+void Output_Writer::Save(int cycle, double time){
+
+    snapshots++;
+
+    if (direct){
+        Trace_Span span("Output write");
+        auto start = std::chrono::steady_clock::now();
+        paraview.SetCycle(cycle);
+        paraview.SetTime(time);
+        paraview.Save();
+        write_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        Measure(cycle);
+        return;
+    }
+
+    //Collect the fields of the group in the free slot, the
+    //other one may still be in use by the I/O thread
+    Output_Slot &slot = slots[current];
+    if (slot.sequence != pmesh->GetSequence()){
+        Release(slot);
+        Stage(slot);
+    }
+    Gather(slot);
+
+    //The collection is only modified while the I/O thread is idle
+    {
+        Trace_Span span("Output wait");
+        Finish();
+    }
+    if (group_rank == 0 && config.lossy_output){
+        if (async)
+            writer = std::thread(&Output_Writer::Archive, this, current, cycle, time);
+        else
+            Archive(current, cycle, time);
+    } else if (group_rank == 0){
+        paraview.SetMesh(writer_comm, slot.mesh);
+        for (unsigned int ii = 0; ii < fields.size(); ii++)
+            paraview.RegisterField(names[ii], slot.fields[ii]);
+        paraview.SetCycle(cycle);
+        paraview.SetTime(time);
+        if (async)
+            writer = std::thread(&Output_Writer::Write, this);
+        else
+            Write();
+    }
+    current = 1 - current;
+}
+
+//Wait for the I/O thread
+void Output_Writer::Finish(){
+    if (writer.joinable())
+        writer.join();
+}
+
+//Serial copy of the local elements, an adapted mesh is copied without
+//its refinement tree (hanging nodes are plain vertices) so it can be
+//printed and read as a conforming mesh
+static Mesh *local_mesh(ParMesh *pmesh){
+    Mesh *local = new Mesh(pmesh->Dimension(), pmesh->GetNV(), pmesh->GetNE(), 0, pmesh->SpaceDimension());
+    for (int ii = 0; ii < pmesh->GetNV(); ii++)
+        local->AddVertex(pmesh->GetVertex(ii));
+    for (int ii = 0; ii < pmesh->GetNE(); ii++)
+        local->AddElement(pmesh->GetElement(ii)->Duplicate(local));
+    //The orientation is kept so the element dofs match the ones of pmesh
+    local->FinalizeTopology(false);
+    local->Finalize(false, false);
+    return local;
+}
+
+//Create the staging copy of the meshes of the group in its writer,
+//it has its own finite elements so no scratch data is shared with
+//the solver thread. It is created again when the mesh is adapted
+void Output_Writer::Stage(Output_Slot &slot){
+
+    slot.sequence = pmesh->GetSequence();
+
+    //Local fields on the serial copy of the local mesh (element by
+    //element, so the hanging dofs of adapted meshes are free)
+    int dim = pmesh->Dimension();
+    slot.fec_H1 = new H1_FECollection(config.order, dim);
+    slot.fec_ND = new ND_FECollection(config.order, dim);
+    slot.local = local_mesh(pmesh);
+    slot.local_H1 = new FiniteElementSpace(slot.local, slot.fec_H1);
+    slot.local_ND = new FiniteElementSpace(slot.local, slot.fec_ND);
+    int local_size = 0;
+    for (unsigned int ii = 0; ii < fields.size(); ii++){
+        bool nedelec = (fields[ii]->FESpace()->FEColl()->GetContType() == FiniteElementCollection::TANGENTIAL);
+        local_size += (nedelec ? slot.local_ND : slot.local_H1)->GetVSize();
+    }
+    slot.local_values.SetSize(local_size);
+    for (unsigned int ii = 0, offset = 0; ii < fields.size(); ii++){
+        bool nedelec = (fields[ii]->FESpace()->FEColl()->GetContType() == FiniteElementCollection::TANGENTIAL);
+        GridFunction *field = new GridFunction(nedelec ? slot.local_ND : slot.local_H1, slot.local_values.GetData() + offset);
+        offset += field->Size();
+        slot.local_fields.push_back(field);
+    }
+
+    //Send the local meshes to the writer
+    std::ostringstream oss;
+    oss.precision(16);
+    if (group_rank != 0) slot.local->Print(oss);
+    string local_mesh = oss.str();
+    int local_length = local_mesh.size();
+
+    std::vector<int> lengths(group_size), mesh_displs(group_size);
+    MPI_Gather(&local_length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, group_comm);
+    slot.counts.resize(group_size);
+    slot.displs.resize(group_size);
+    MPI_Gather(&local_size, 1, MPI_INT, slot.counts.data(), 1, MPI_INT, 0, group_comm);
+
+    int total_length = 0, total_size = 0;
+    for (int ii = 0; ii < group_size; ii++){
+        mesh_displs[ii] = total_length;
+        slot.displs[ii] = total_size;
+        total_length += lengths[ii];
+        total_size += slot.counts[ii];
+    }
+    string meshes(total_length, ' ');
+    MPI_Gatherv(&local_mesh[0], local_length, MPI_CHAR, &meshes[0], lengths.data(), mesh_displs.data(), MPI_CHAR, 0, group_comm);
+
+    slot.mesh = slot.local;
+    if (group_rank != 0) return;
+
+    //Rebuild the pieces of the group, the writer uses its own mesh
+    slot.values.SetSize(total_size);
+    for (int ii = 0; ii < group_size; ii++){
+        Mesh *piece;
+        if (ii == 0){
+            piece = new Mesh(*slot.local);
+        } else {
+            std::istringstream iss(meshes.substr(mesh_displs[ii], lengths[ii]));
+            piece = new Mesh(iss, 1, 0, false);
+        }
+        slot.pieces.push_back(piece);
+        slot.fespaces.push_back(new FiniteElementSpace(piece, slot.fec_H1));
+        slot.fespaces.push_back(new FiniteElementSpace(piece, slot.fec_ND));
+
+        int offset = slot.displs[ii];
+        for (unsigned int jj = 0; jj < fields.size(); jj++){
+            bool nedelec = (fields[jj]->FESpace()->FEColl()->GetContType() == FiniteElementCollection::TANGENTIAL);
+            GridFunction *field = new GridFunction(slot.fespaces[2*ii + (nedelec ? 1 : 0)], slot.values.GetData() + offset);
+            offset += field->Size();
+            slot.piece_fields.push_back(field);
+        }
+        MFEM_VERIFY(offset == slot.displs[ii] + slot.counts[ii], "Output fields do not match the mesh of processor " + to_string(ii));
+    }
+
+    //A single piece is printed as it is, several are joined in one mesh
+    if (group_size == 1){
+        slot.mesh = slot.pieces[0];
+        slot.fields = slot.piece_fields;
+    } else {
+        slot.mesh = new Mesh(slot.pieces.data(), group_size);
+        slot.fields.assign(fields.size(), (GridFunction*)NULL);
+    }
+}
+
+//Send the fields of the group to its writer
+void Output_Writer::Gather(Output_Slot &slot){
+    Trace_Span span("Output gather");
+
+    //Copy the local fields on the serial local mesh (same elements)
+    for (unsigned int ii = 0; ii < fields.size(); ii++){
+        const FiniteElementSpace *fespace = fields[ii]->FESpace();
+        FiniteElementSpace *local_fespace = slot.local_fields[ii]->FESpace();
+        for (int jj = 0; jj < pmesh->GetNE(); jj++){
+            fespace->GetElementVDofs(jj, dofs);
+            local_fespace->GetElementVDofs(jj, local_dofs);
+            fields[ii]->GetSubVector(dofs, element_values);
+            slot.local_fields[ii]->SetSubVector(local_dofs, element_values);
+        }
+    }
+
+    MPI_Gatherv(slot.local_values.GetData(), slot.local_values.Size(), MPI_DOUBLE,
+                slot.values.GetData(), slot.counts.data(), slot.displs.data(), MPI_DOUBLE, 0, group_comm);
+
+    if (group_rank != 0 || group_size == 1 || config.lossy_output) return;
+
+    //Join the fields of the pieces (the piece fields point to the values)
+    std::vector<GridFunction*> pieces(group_size);
+    for (unsigned int ii = 0; ii < fields.size(); ii++){
+        for (int jj = 0; jj < group_size; jj++)
+            pieces[jj] = slot.piece_fields[jj*fields.size() + ii];
+        delete slot.fields[ii];
+        slot.fields[ii] = new GridFunction(slot.mesh, pieces.data(), group_size);
+    }
+}
+
+//Print the attached slot (runs in the I/O thread), as the mesh is
+//serial every writer prints its own piece without communication
+void Output_Writer::Write(){
+    Trace_Span span("Output write");
+    auto start = std::chrono::steady_clock::now();
+
+    paraview.Save();
+
+    write_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Measure(paraview.GetCycle());
+}
+
+//Store the joined fields of a slot in the compressed archive
+void Output_Writer::Archive(int index, int cycle, double time){
+    Trace_Span span("Archive write");
+    auto start = std::chrono::steady_clock::now();
+
+    Output_Slot &slot = slots[index];
+    int pieces = slot.pieces.size();
+    char name[64];
+
+    //The meshes are only written again after the mesh is adapted
+    if (archive_sequence != slot.sequence){
+        archive_sequence = slot.sequence;
+        archive_mesh++;
+        string buffer;
+        buffer.append(reinterpret_cast<const char*>(&pieces), sizeof(int));
+        for (int ii = 0; ii < pieces; ii++){
+            std::ostringstream oss;
+            oss.precision(16);
+            slot.pieces[ii]->Print(oss);
+            long length = oss.str().size();
+            buffer.append(reinterpret_cast<const char*>(&length), sizeof(long));
+            buffer.append(oss.str());
+        }
+        snprintf(name, sizeof(name), "mesh_%06d_%06d.bin", archive_mesh, group);
+        std::ofstream out((archive_folder + name).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(buffer.data(), buffer.size());
+        out.close();
+        bytes += buffer.size();
+        files++;
+    }
+
+    string buffer;
+    int header[6] = {archive_version, config.order, cycle, pieces, (int)fields.size(), archive_mesh};
+    buffer.append(archive_magic, 8);
+    buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+    buffer.append(reinterpret_cast<const char*>(&time), sizeof(double));
+    for (unsigned int ii = 0; ii < fields.size(); ii++){
+        int info[2] = {fields[ii]->FESpace()->FEColl()->GetContType() == FiniteElementCollection::TANGENTIAL, (int)names[ii].size()};
+        buffer.append(reinterpret_cast<const char*>(info), sizeof(info));
+        buffer.append(names[ii]);
+    }
+    for (unsigned int ii = 0; ii < slot.piece_fields.size(); ii++)
+        CompressField(slot.piece_fields[ii]->GetData(), slot.piece_fields[ii]->Size(), config.lossy_abstol, config.lossy_reltol, buffer);
+
+    snprintf(name, sizeof(name), "cycle_%06d_%06d.bin", cycle, group);
+    std::ofstream out((archive_folder + name).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(buffer.data(), buffer.size());
+    out.close();
+    bytes += buffer.size();
+    files++;
+
+    write_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Add the files of this processor in the last snapshot, the
+//first one also counts the parallel header of the cycle
+void Output_Writer::Measure(int cycle){
+    char path[64];
+    snprintf(path, sizeof(path), "/Cycle%06d/", cycle);
+    string folder = paraview.GetPrefixPath() + paraview.GetCollectionName() + path;
+
+    snprintf(path, sizeof(path), "proc%06d.vtu", paraview.GetMyRank());
+    std::ifstream piece(folder + path, std::ios::binary | std::ios::ate);
+    if (piece){
+        bytes += piece.tellg();
+        files++;
+    }
+    if (paraview.GetMyRank() == 0){
+        std::ifstream header(folder + "data.pvtu", std::ios::binary | std::ios::ate);
+        if (header){
+            bytes += header.tellg();
+            files++;
+        }
+    }
+}
+
+//Delete the staging copy of a slot (not in use by the I/O thread)
+void Output_Writer::Release(Output_Slot &slot){
+    if (group_size > 1 && group_rank == 0){
+        for (unsigned int jj = 0; jj < slot.fields.size(); jj++)
+            delete slot.fields[jj];
+        delete slot.mesh;
+    }
+    for (unsigned int jj = 0; jj < slot.piece_fields.size(); jj++)
+        delete slot.piece_fields[jj];
+    for (unsigned int jj = 0; jj < slot.fespaces.size(); jj++)
+        delete slot.fespaces[jj];
+    for (unsigned int jj = 0; jj < slot.pieces.size(); jj++)
+        delete slot.pieces[jj];
+    for (unsigned int jj = 0; jj < slot.local_fields.size(); jj++)
+        delete slot.local_fields[jj];
+    delete slot.local_H1;
+    delete slot.local_ND;
+    delete slot.local;
+    delete slot.fec_H1;
+    delete slot.fec_ND;
+
+    slot.mesh = NULL;
+    slot.local = NULL;
+    slot.local_H1 = NULL;
+    slot.local_ND = NULL;
+    slot.fec_H1 = NULL;
+    slot.fec_ND = NULL;
+    slot.pieces.clear();
+    slot.fespaces.clear();
+    slot.piece_fields.clear();
+    slot.fields.clear();
+    slot.local_fields.clear();
+    slot.sequence = -1;
+}
+
+Output_Writer::~Output_Writer(){
+    Finish();
+    for (int ii = 0; ii < 2; ii++)
+        Release(slots[ii]);
+    MPI_Comm_free(&group_comm);
+    if (writer_comm != MPI_COMM_NULL) MPI_Comm_free(&writer_comm);
+}
@@ -0,0 +1,90 @@
+#include "header.h"
+
+//Setup function that keeps the current hierarchy
+static HYPRE_Int KeepHierarchy(HYPRE_Solver solver, HYPRE_ParCSRMatrix A, HYPRE_ParVector b, HYPRE_ParVector x){
+    return 0;
+}
+
+//Full setup of the hierarchy, measured by the timers
+static HYPRE_Int TimedSetup(HYPRE_Solver solver, HYPRE_ParCSRMatrix A, HYPRE_ParVector b, HYPRE_ParVector x){
+    Region_Timer timer(REGION_AMG_SETUP);
+    return HYPRE_BoomerAMGSetup(solver, A, b, x);
+}
+
+Reusable_BoomerAMG::Reusable_BoomerAMG():
+    HypreBoomerAMG(),
+    threshold(0.),
+    reuse(false), stale(true),
+    base_iterations(-1), setup_rows(0),
+    full_setups(0), reused_setups(0)
+{}
+
+//Enable the reuse of the hierarchy (threshold <= 0 disables it)
+void Reusable_BoomerAMG::SetReuse(double threshold){
+    this->threshold = threshold;
+    SetSmoother();
+}
+
+//Update the operator, keeping the hierarchy when it is still good enough
+void Reusable_BoomerAMG::SetOperator(const Operator &op){
+    const HypreParMatrix *new_A = dynamic_cast<const HypreParMatrix *>(&op);
+    MFEM_VERIFY(new_A, "new Operator must be a HypreParMatrix!");
+
+    //Only the solver sets the operator (HyprePCG passes it to its
+    //preconditioner), as a new matrix may get the address of the old
+    //one. The previous matrix may be deleted already, so its size is kept
+    if (threshold <= 0. || stale || !A || new_A->GetGlobalNumRows() != setup_rows){
+        //Full setup of the hierarchy
+        HypreBoomerAMG::SetOperator(op);
+        SetSmoother();
+        setup_rows = new_A->GetGlobalNumRows();
+        reuse = false;
+        stale = false;
+        base_iterations = -1;
+        full_setups++;
+    } else {
+        //Only the fine level changes, hypre takes it from the 
+        //matrix given to the solve and the smoother is computed 
+        //on the fly from it
+        A = const_cast<HypreParMatrix *>(new_A);
+        setup_called = 0;
+        reuse = true;
+        reused_setups++;
+    }
+}
+
+//Setup function according to the state of the hierarchy
+HYPRE_PtrToParSolverFcn Reusable_BoomerAMG::SetupFcn() const{
+    if (reuse) return (HYPRE_PtrToParSolverFcn) KeepHierarchy;
+    return (HYPRE_PtrToParSolverFcn) TimedSetup;
+}
+
+//Mark the hierarchy as stale if the solver iterations grow too much
+void Reusable_BoomerAMG::Monitor(int iterations){
+    if (threshold <= 0.) return;
+    if (base_iterations < 0)
+        base_iterations = iterations;
+    else if (iterations > threshold*max(base_iterations, 1))
+        stale = true;
+}
+
+//Force a full setup with the next operator (the mesh changed)
+void Reusable_BoomerAMG::Invalidate(){
+    stale = true;
+}
+
+int Reusable_BoomerAMG::GetFullSetups() const{
+    return full_setups;
+}
+
+int Reusable_BoomerAMG::GetReusedSetups() const{
+    return reused_setups;
+}
+
+//Hybrid symmetric Gauss-Seidel does not store data of the fine 
+//level (as the l1 norms of the default smoother), so it stays
+//consistent when only the fine operator is replaced
+void Reusable_BoomerAMG::SetSmoother(){
+    if (threshold > 0.)
+        HYPRE_BoomerAMGSetRelaxType(*this, 6);
+}
@@ -0,0 +1,99 @@
+#include "header.h"
+
+/****
+ * Point probes (settings/probes.txt, one "r z [name]" per line, # for
+ * comments). Each probe is located once (and again after the mesh
+ * changes) and sampled on every step by the processor that owns it,
+ * which appends to results/probes/<name>.csv without communication
+ ****/
+static const string probes_file = "settings/probes.txt";
+static const string probes_folder = "results/probes/";
+static const size_t probes_buffer = 1 << 16;
+
+//Read the probes and create their files
+Probe_Writer::Probe_Writer(Config config, ParMesh *pmesh):
+    config(config),
+    pmesh(pmesh),
+    sequence(-1)
+{
+    std::ifstream in(probes_file.c_str());
+    string line;
+    while (std::getline(in, line)){
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        double r, z;
+        if (!(iss >> r >> z)) continue;
+        string name;
+        if (!(iss >> name)) name = "probe_" + to_string(names.size());
+        positions.push_back(r);
+        positions.push_back(z);
+        names.push_back(name);
+    }
+    buffers.resize(names.size());
+
+    //Files are created by the master before any processor writes
+    if (config.master && !config.restart){
+        for (unsigned int ii = 0; ii < names.size(); ii++){
+            std::ofstream out((probes_folder + names[ii] + ".csv").c_str(), std::ios::trunc);
+            out << "Time,Temperature,Salinity,Phase,Velocity_r,Velocity_z\n";
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+//Find the owner, element and reference coordinates of each probe
+void Probe_Writer::Locate(){
+    Flush();
+
+    int points = names.size();
+    DenseMatrix coordinates(2, points);
+    for (int ii = 0; ii < points; ii++){
+        coordinates(0, ii) = positions[2*ii];
+        coordinates(1, ii) = positions[2*ii + 1];
+    }
+    int found = pmesh->FindPoints(coordinates, elements, ips, false);
+    if (config.master && found < points && sequence < 0)
+        cout << "\n" << points - found << " probes are outside of the mesh\n";
+
+    sequence = pmesh->GetSequence();
+}
+
+//Evaluate the probes owned by this processor with the state of the flow solver
+void Probe_Writer::Sample(double time, const ParGridFunction &temperature, const ParGridFunction &salinity, const ParGridFunction &velocity){
+
+    if (names.empty()) return;
+    Region_Timer timer(REGION_DIAGNOSTICS);
+    if (pmesh->GetSequence() != sequence)
+        Locate();
+
+    Vector v(2);
+    char line[160];
+    for (unsigned int ii = 0; ii < names.size(); ii++){
+        if (elements[ii] < 0) continue;
+        double T = temperature.GetValue(elements[ii], ips[ii]);
+        double S = salinity.GetValue(elements[ii], ips[ii]);
+        velocity.GetVectorValue(elements[ii], ips[ii], v);
+        snprintf(line, sizeof(line), "%.10g,%.10g,%.10g,%.10g,%.10g,%.10g\n", time, T, S, Phase(T, S), v(0), v(1));
+        buffers[ii] += line;
+        if (buffers[ii].size() > probes_buffer)
+            Flush(ii);
+    }
+}
+
+//Append the buffer of a probe to its file
+void Probe_Writer::Flush(int index){
+    if (buffers[index].empty()) return;
+    std::ofstream out((probes_folder + names[index] + ".csv").c_str(), std::ios::app);
+    out << buffers[index];
+    buffers[index].clear();
+}
+
+//Append all the buffers
+void Probe_Writer::Flush(){
+    for (unsigned int ii = 0; ii < names.size(); ii++)
+        Flush(ii);
+}
+
+Probe_Writer::~Probe_Writer(){
+    Flush();
+}
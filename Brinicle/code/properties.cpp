@@ -0,0 +1,201 @@
+#include "header.h"
+
+//Physical properties (in T,S)
+double FusionPoint(const double S);
+double Phase(const double T, const double S);
+double HeatInertia(const double T, const double S);
+double HeatDiffusivity(const double T, const double S);
+double SaltDiffusivity(const double T, const double S);
+double Impermeability(const double T, const double S);
+double Density(const double T, const double S);
+double LiquidDensity(const double T, const double S);
+void MaterialProperties(const int size, const double *T, const double *S, const Property_Fields &fields);
+
+//Fusion temperature at a given salinity
+double FusionPoint(const double S){
+    return -(constants.FusionPoint_a*S + constants.FusionPoint_b*pow(S, 3));
+}
+
+//Phase indicator (1 for liquid and 0 for solid)
+double Phase(const double T, const double S){
+    return 0.5*(1+tanh(5*EpsilonInv*(T-FusionPoint(S))));
+}
+
+//Coefficient for the mass term in the temperature equation
+double HeatInertia(const double T, const double S){
+    return constants.TemperatureMass_s + (constants.TemperatureMass_l-constants.TemperatureMass_l)*Phase(T, S);
+}
+
+//Coefficient for the diffusion term in the temperature equation
+double HeatDiffusivity(const double T, const double S){ 
+    return constants.TemperatureDiffusion_s + (constants.TemperatureDiffusion_l-constants.TemperatureDiffusion_s)*Phase(T, S);
+}
+
+//Coefficient for the diffusion term in the salinity equation
+double SaltDiffusivity(const double T, const double S){
+    return constants.SalinityDiffusion_s + (constants.SalinityDiffusion_l-constants.SalinityDiffusion_s)*Phase(T, S);
+}
+
+//Inverse of the brinkman penalization permeability
+double Impermeability(const double T, const double S){
+    return Epsilon + pow(1-Phase(T, S), 2)/(pow(Phase(T, S), 3) + Epsilon);
+} 
+
+//Relative density of the fluid
+double Density(const double T, const double S){
+    return Phase(T, S)*(
+          (constants.Density_a0  + 
+           constants.Density_a1*(T)  + 
+           constants.Density_a2*pow(T, 2)      + 
+           constants.Density_a3*pow(T, 3)      +
+           constants.Density_a4*pow(T, 4))*(S) + 
+          (constants.Density_b0  + 
+           constants.Density_b1*(T)  +
+           constants.Density_b2*pow(T, 2))*pow(abs(S), 1.5)  +
+          (constants.Density_c0)*pow(S, 2)
+          );
+}
+
+//Relative density of the liquid phase (Horner form)
+double LiquidDensity(const double T, const double S){
+    double S_abs = abs(S);
+    return ((((constants.Density_a4*T + 
+               constants.Density_a3)*T + 
+               constants.Density_a2)*T + 
+               constants.Density_a1)*T + 
+               constants.Density_a0)*S +
+           ((constants.Density_b2*T + 
+             constants.Density_b1)*T + 
+             constants.Density_b0)*S_abs*sqrt(S_abs) +
+           constants.Density_c0*S*S;
+}
+
+//Tabulate the liquid density in a points x points grid
+Density_Table::Density_Table(int points):
+    points(max(points, 2)),
+    T_min(constants.Table_T_min), T_max(constants.Table_T_max),
+    S_min(constants.Table_S_min), S_max(constants.Table_S_max),
+    values(this->points*this->points),
+    error(0.)
+{
+    double T_step = (T_max - T_min)/(this->points - 1);
+    double S_step = (S_max - S_min)/(this->points - 1);
+    T_step_inv = 1./T_step;
+    S_step_inv = 1./S_step;
+
+    //Values at the nodes of the table
+    double scale = 0.;
+    for (int ii = 0; ii < this->points; ii++){
+        for (int jj = 0; jj < this->points; jj++){
+            values(ii*this->points + jj) = LiquidDensity(T_min + ii*T_step, S_min + jj*S_step);
+            scale = max(scale, abs(values(ii*this->points + jj)));
+        }
+    }
+
+    //The interpolation error is largest at the center of the cells
+    for (int ii = 0; ii < this->points - 1; ii++){
+        for (int jj = 0; jj < this->points - 1; jj++){
+            double T = T_min + (ii + 0.5)*T_step;
+            double S = S_min + (jj + 0.5)*S_step;
+            error = max(error, abs(Eval(T, S) - LiquidDensity(T, S)));
+        }
+    }
+    error /= max(scale, 1E-16);
+}
+
+//Relative density of the liquid (without the phase factor)
+double Density_Table::Eval(const double T, const double S) const{
+    if (T < T_min || T > T_max || S < S_min || S > S_max)
+        return LiquidDensity(T, S);
+
+    double x = (T - T_min)*T_step_inv;
+    double y = (S - S_min)*S_step_inv;
+    int ii = min((int)x, points - 2);
+    int jj = min((int)y, points - 2);
+    double u = x - ii;
+    double v = y - jj;
+
+    const double *cell = values.GetData() + ii*points + jj;
+    return (1-u)*((1-v)*cell[0] + v*cell[1]) + u*((1-v)*cell[points] + v*cell[points + 1]);
+}
+
+//All the physical properties on a set of nodes (timed by the callers,
+//so the kernel does not depend on the profiling objects)
+void MaterialProperties(const int size, const double *T, const double *S, const Property_Fields &fields){
+
+    //Nodes are processed in blocks, first the phase is calculated (only
+    //one tanh per node) and then each requested field is filled from it, 
+    //so every loop is branch free and the block stays in cache
+    const int block = 256;
+    double P[block];
+    double T_shift[block];
+
+    const double I_s = constants.TemperatureMass_s;
+    //Same (zero) liquid-solid jump as HeatInertia, kept so both versions
+    //give bit-identical results
+    const double I_ls = constants.TemperatureMass_l-constants.TemperatureMass_l;
+    const double D0_s = constants.TemperatureDiffusion_s;
+    const double D0_ls = constants.TemperatureDiffusion_l-constants.TemperatureDiffusion_s;
+    const double D1_s = constants.SalinityDiffusion_s;
+    const double D1_ls = constants.SalinityDiffusion_l-constants.SalinityDiffusion_s;
+
+    for (int start = 0; start < size; start += block){
+        const int n = min(block, size - start);
+        const double *t = T + start;
+        const double *s = S + start;
+
+        //Phase and distance to the fusion point (Horner form)
+        for (int ii = 0; ii < n; ii++){
+            T_shift[ii] = t[ii] + s[ii]*(constants.FusionPoint_a + constants.FusionPoint_b*s[ii]*s[ii]);
+            P[ii] = 0.5*(1+tanh(5*EpsilonInv*T_shift[ii]));
+        }
+
+        //Relative density, computed before the temperature is shifted 
+        //as both arrays can be the same
+        if (fields.density && fields.density_table){
+            double *rho = fields.density + start;
+            for (int ii = 0; ii < n; ii++)
+                rho[ii] = P[ii]*fields.density_table->Eval(t[ii], s[ii]);
+        } else if (fields.density){
+            double *rho = fields.density + start;
+            for (int ii = 0; ii < n; ii++)
+                rho[ii] = P[ii]*LiquidDensity(t[ii], s[ii]);
+        }
+
+        if (fields.phase){
+            double *phase = fields.phase + start;
+            for (int ii = 0; ii < n; ii++)
+                phase[ii] = P[ii];
+        }
+
+        if (fields.heat_inertia){
+            double *heat_inertia = fields.heat_inertia + start;
+            for (int ii = 0; ii < n; ii++)
+                heat_inertia[ii] = I_s + I_ls*P[ii];
+        }
+
+        if (fields.heat_diffusivity){
+            double *heat_diffusivity = fields.heat_diffusivity + start;
+            for (int ii = 0; ii < n; ii++)
+                heat_diffusivity[ii] = D0_s + D0_ls*P[ii];
+        }
+
+        if (fields.salt_diffusivity){
+            double *salt_diffusivity = fields.salt_diffusivity + start;
+            for (int ii = 0; ii < n; ii++)
+                salt_diffusivity[ii] = D1_s + D1_ls*P[ii];
+        }
+
+        if (fields.impermeability){
+            double *impermeability = fields.impermeability + start;
+            for (int ii = 0; ii < n; ii++)
+                impermeability[ii] = Epsilon + (1-P[ii])*(1-P[ii])/(P[ii]*P[ii]*P[ii] + Epsilon);
+        }
+
+        if (fields.temperature){
+            double *temperature = fields.temperature + start;
+            for (int ii = 0; ii < n; ii++)
+                temperature[ii] = T_shift[ii];
+        }
+    }
+}
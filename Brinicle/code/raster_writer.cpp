@@ -0,0 +1,148 @@
+#include "header.h"
+#include <cstdint>
+#include <cstring>
+
+/****
+ * Fields interpolated on a Cartesian grid of nr x nz points (including
+ * the borders of the domain), written by the master as a legacy VTK
+ * image (results/raster/raster_CCCCCC.vtk, float32 big endian). Scalar
+ * fields are SCALARS and the Nedelec ones VECTORS (r, z, 0). Points
+ * outside of the mesh are NaN
+ ****/
+static const string raster_folder = "results/raster/";
+
+//Legacy VTK binary data is big endian
+static void put_big_endian(string &buffer, const void *value, int bytes){
+    uint64_t bits = 0;
+    memcpy(&bits, value, bytes);
+    for (int ii = bytes - 1; ii >= 0; ii--)
+        buffer.push_back((char)((bits >> (8*ii)) & 0xFF));
+}
+
+//Initialization of the grid
+Raster_Writer::Raster_Writer(Config config, ParMesh *pmesh):
+    config(config),
+    pmesh(pmesh),
+    nr(config.raster_nr),
+    nz(config.raster_nz),
+    sequence(-1),
+    saves(0),
+    time_spent(0.)
+{
+    MFEM_VERIFY(nr >= 2 && nz >= 2, "The raster needs at least 2x2 points");
+}
+
+//Register a field of the program
+void Raster_Writer::RegisterField(const string &name, ParGridFunction *field){
+    names.push_back(name);
+    fields.push_back(field);
+    components.push_back((field->FESpace()->FEColl()->GetContType() == FiniteElementCollection::TANGENTIAL) ? 2 : 1);
+}
+
+//Find the elements of the points of the grid, each point
+//belongs to only one processor
+void Raster_Writer::Locate(){
+    int points = nr*nz;
+    double dr = (RMax - RMin)/(nr - 1);
+    double dz = (ZMax - ZMin)/(nz - 1);
+
+    DenseMatrix coordinates(2, points);
+    for (int jj = 0; jj < nz; jj++){
+        for (int ii = 0; ii < nr; ii++){
+            coordinates(0, jj*nr + ii) = RMin + ii*dr;
+            coordinates(1, jj*nr + ii) = ZMin + jj*dz;
+        }
+    }
+    pmesh->FindPoints(coordinates, elements, ips, false);
+
+    std::vector<int> owned(points);
+    for (int ii = 0; ii < points; ii++)
+        owned[ii] = (elements[ii] >= 0) ? 1 : 0;
+    found.resize(points);
+    MPI_Reduce(owned.data(), found.data(), points, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    sequence = pmesh->GetSequence();
+}
+
+//Interpolate the fields and print them
+void Raster_Writer::Save(int cycle, double time){
+
+    double start = MPI_Wtime();
+
+    //The points are located again after the mesh is adapted
+    if (pmesh->GetSequence() != sequence)
+        Locate();
+
+    int points = nr*nz;
+    int size = 0;
+    for (unsigned int ii = 0; ii < fields.size(); ii++)
+        size += components[ii]*points;
+    local.SetSize(size);
+    local = 0.;
+
+    Vector value(2);
+    int offset = 0;
+    for (unsigned int ii = 0; ii < fields.size(); ii++){
+        for (int kk = 0; kk < points; kk++){
+            if (elements[kk] < 0) continue;
+            if (components[ii] == 1){
+                local(offset + kk) = fields[ii]->GetValue(elements[kk], ips[kk]);
+            } else {
+                fields[ii]->GetVectorValue(elements[kk], ips[kk], value);
+                local(offset + kk) = value(0);
+                local(offset + points + kk) = value(1);
+            }
+        }
+        offset += components[ii]*points;
+    }
+
+    if (config.master) global.SetSize(size);
+    MPI_Reduce(local.GetData(), global.GetData(), size, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (config.master){
+        double dr = (RMax - RMin)/(nr - 1);
+        double dz = (ZMax - ZMin)/(nz - 1);
+
+        std::ostringstream header;
+        header << "# vtk DataFile Version 3.0\n"
+               << "Brinicle raster\n"
+               << "BINARY\n"
+               << "DATASET STRUCTURED_POINTS\n"
+               << "DIMENSIONS " << nr << " " << nz << " 1\n"
+               << std::setprecision(16)
+               << "ORIGIN " << RMin << " " << ZMin << " 0\n"
+               << "SPACING " << dr << " " << dz << " 1\n"
+               << "FIELD FieldData 1\n"
+               << "TIME 1 1 double\n";
+        string buffer = header.str();
+        put_big_endian(buffer, &time, sizeof(double));
+        buffer += "\nPOINT_DATA " + to_string(points) + "\n";
+
+        offset = 0;
+        for (unsigned int ii = 0; ii < fields.size(); ii++){
+            if (components[ii] == 1)
+                buffer += "SCALARS " + names[ii] + " float 1\nLOOKUP_TABLE default\n";
+            else
+                buffer += "VECTORS " + names[ii] + " float\n";
+            for (int kk = 0; kk < points; kk++){
+                for (int cc = 0; cc < ((components[ii] == 1) ? 1 : 3); cc++){
+                    float data = 0.;
+                    if (cc < components[ii])
+                        data = found[kk] ? global(offset + cc*points + kk) : NAN;
+                    put_big_endian(buffer, &data, sizeof(float));
+                }
+            }
+            buffer += "\n";
+            offset += components[ii]*points;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "raster_%06d.vtk", cycle);
+        std::ofstream out((raster_folder + name).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(buffer.data(), buffer.size());
+        out.close();
+    }
+
+    saves++;
+    time_spent += MPI_Wtime() - start;
+}
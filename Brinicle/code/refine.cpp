@@ -0,0 +1,141 @@
+#include "header.h"
+
+//Adapt the mesh to the phase interface (initial refinement projects
+//the initial conditions again on the new mesh)
+void Artic_sea::refine_mesh(bool initial){
+
+    //Only nonconforming meshes can be adapted
+    if (!pmesh->Nonconforming()) return;
+    Region_Timer timer(REGION_AMR);
+
+    //Update the state on the current mesh
+    temperature->Distribute(X.GetBlock(0));
+    salinity->Distribute(X.GetBlock(1));
+    vorticity->Distribute(Y.GetBlock(0));
+    stream->Distribute(Y.GetBlock(1));
+    velocity->Distribute(Velocity);
+    rvelocity->Distribute(rVelocity);
+
+    //Each element is decided on its own: first the elements behind the
+    //interface are derefined (with some hysteresis), then the interface
+    //is marked again on the new mesh and refined
+    Vector indicator;
+    Array<int> marked;
+    mark_interface(indicator, marked);
+    bool changed = pmesh->DerefineByError(indicator, 0.5*config.amr_threshold, 1);
+    if (changed){
+        update_fields();
+        mark_interface(indicator, marked);
+    }
+
+    long local_marked = marked.Size(), global_marked;
+    MPI_Allreduce(&local_marked, &global_marked, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (global_marked > 0){
+        pmesh->GeneralRefinement(marked, 1, 1);
+        update_fields();
+        changed = true;
+    }
+    if (!changed) return;
+
+    //Balance the load between the processors
+    adaptations++;
+    if (config.amr_rebalance > 0 && adaptations % config.amr_rebalance == 0){
+        pmesh->Rebalance();
+        update_fields();
+    }
+    fespace_H1->UpdatesFinished();
+    fespace_ND->UpdatesFinished();
+
+    //New sizes of the system
+    double null;
+    pmesh->GetCharacteristics(h_min, null, null, null);
+    size_H1 = fespace_H1->GlobalTrueVSize();
+    size_ND = fespace_ND->GlobalTrueVSize();
+
+    block_offsets_H1[0] = 0;
+    block_offsets_H1[1] = fespace_H1->TrueVSize();
+    block_offsets_H1[2] = fespace_H1->TrueVSize();
+    block_offsets_H1.PartialSum();
+
+    X.Update(block_offsets_H1);
+    temperature->GetTrueDofs(X.GetBlock(0));
+    salinity->GetTrueDofs(X.GetBlock(1));
+
+    Y.Update(block_offsets_H1);
+    vorticity->GetTrueDofs(Y.GetBlock(0));
+    stream->GetTrueDofs(Y.GetBlock(1));
+
+    delete Velocity;
+    delete rVelocity;
+    Velocity = new HypreParVector(fespace_ND);
+    rVelocity = new HypreParVector(fespace_ND);
+    velocity->GetTrueDofs(*Velocity);
+    rvelocity->GetTrueDofs(*rVelocity);
+
+    //Update the operators on the new mesh (keeping their solvers)
+    transport_oper->Update(block_offsets_H1);
+    flow_oper->Update(block_offsets_H1);
+    if (initial) transport_oper->SetInitialConditions(X);
+
+    flow_oper->SetParameters(X);
+    flow_oper->Solve(Y, *Velocity, *rVelocity);
+
+    //ARKODE continues with its step size and error history
+    if (!initial) resize_ode_solver();
+}
+
+//Phase range inside each element as indicator of the interface, the
+//marked elements are kept between the uniform depth and amr_levels
+//levels above it (elements that must not be derefined get infinity)
+void Artic_sea::mark_interface(Vector &indicator, Array<int> &marked){
+    Property_Fields fields;
+    fields.phase = phase->GetData();
+    {
+        Region_Timer timer(REGION_MATERIALS);
+        MaterialProperties(phase->Size(), temperature->GetData(), salinity->GetData(), fields);
+    }
+
+    int max_depth = amr_base_depth + config.amr_levels;
+    indicator.SetSize(pmesh->GetNE());
+    marked.SetSize(0);
+    Array<int> dofs;
+    Vector values;
+    for (int ee = 0; ee < pmesh->GetNE(); ee++){
+        fespace_H1->GetElementVDofs(ee, dofs);
+        phase->GetSubVector(dofs, values);
+        indicator(ee) = values.Max() - values.Min();
+
+        int depth = pmesh->ncmesh->GetElementDepth(ee);
+        if (indicator(ee) > config.amr_threshold && depth < max_depth){
+            marked.Append(ee);
+            indicator(ee) = infinity();
+        }
+        if (depth <= amr_base_depth)
+            indicator(ee) = infinity();
+    }
+}
+
+//Resize ARKODE to the new state, it keeps its step size and error
+//history (the dense output of the last step is lost)
+void Artic_sea::resize_ode_solver(){
+    SundialsNVector X_new(MPI_COMM_WORLD, X.GetData(), X.Size(), 2*size_H1);
+    int flag = ARKStepResize(arkode->GetMem(), X_new, 1., t, NULL, NULL);
+    MFEM_VERIFY(flag == ARK_SUCCESS, "ARKStepResize failed with flag " << flag);
+
+    //The linear solver interface keeps vectors of the previous size
+    arkode->UseMFEMLinearSolver();
+}
+
+//Update the spaces and fields after a change of the mesh
+void Artic_sea::update_fields(){
+    fespace_H1->Update();
+    fespace_ND->Update();
+
+    temperature->Update();
+    salinity->Update();
+    phase->Update();
+    vorticity->Update();
+    stream->Update();
+    velocity->Update();
+    rvelocity->Update();
+}
@@ -10,29 +10,54 @@ Config::Config(int pid, int nproc):
 //Initialization of the program
 Artic_sea::Artic_sea(Config config):
     config(config),
-    t(config.t_init), dt(config.dt_init), last(false),
-    vis_steps(config.vis_steps_max), vis_print(0),
+    iteration(1), t(config.t_init), dt(config.dt_init), last(false),
+    vis_iteration(1), vis_steps(config.vis_steps_max), vis_print(0),
     pmesh(NULL), 
     fec_H1(NULL), fec_ND(NULL), 
     fespace_H1(NULL), fespace_ND(NULL),
     block_offsets_H1(3),
+    amr_base_depth(0), adaptations(0),
     temperature(NULL), salinity(NULL), phase(NULL), 
     vorticity(NULL), stream(NULL), 
     velocity(NULL), rvelocity(NULL), 
     Velocity(NULL), rVelocity(NULL),
     transport_oper(NULL), flow_oper(NULL),
     ode_solver(NULL), arkode(NULL),
-    paraview_out(NULL)
+    paraview_out(NULL),
+    raster_out(NULL), probes(NULL),
+    diagnostics_time(-1.), diagnostics_salt(0.), diagnostics_flux(0.),
+    diagnostics_operation(MPI_OP_NULL),
+    timer_prints(0), counters_available(0),
+    telemetry_start(0.), telemetry_flush(0.),
+    checkpoint_position(0), dt_restart(0.),
+    checkpoints(0), checkpoint_clock(0.),
+    checkpoint_overhead(0.), checkpoint_write_time(0.),
+    loop_time(0.)
 {}
 
 //Run the program
 void Artic_sea::run(const char *mesh_file){
+    if (config.trace) StartTrace();
+
+    //Counters available in all the processors
+    if (config.hardware_counters){
+        int available = StartCounters();
+        MPI_Allreduce(&available, &counters_available, 1, MPI_INT, MPI_BAND, MPI_COMM_WORLD);
+        if (config.master && counters_available != (1 << HARDWARE_COUNTERS) - 1)
+            cout << "Some hardware counters are not available (perf_event), they are not reported\n";
+    }
     make_grid(mesh_file);
     assemble_system();
-    for (iteration = 1, vis_iteration = 1; !last; iteration++, vis_iteration++)
+    start_checkpoints();
+    double start = MPI_Wtime();
+    for (; !last; iteration++, vis_iteration++){
         time_step();
+        if (checkpoint_due()) save_checkpoint();
+    }
+    loop_time = MPI_Wtime() - start;
     total_time = toc();
     output_results();
+    if (config.hardware_counters) StopCounters();
 }
 
 //Delete used memory
@@ -52,6 +77,20 @@ Transport_Operator::~Transport_Operator(){
     delete T1_e; 
     delete B0;
     delete B1;
+    delete m0_pa;
+    delete m1_pa;
+    delete k0_pa;
+    delete k1_pa;
+    delete c0_pa;
+    delete c1_pa;
+    delete K0_pa;
+    delete K1_pa;
+    delete T0_pa;
+    delete T1_pa;
+    delete M0_pa_prec;
+    delete M1_pa_prec;
+    delete T0_pa_prec;
+    delete T1_pa_prec;
 }
 
 Flow_Operator::~Flow_Operator(){
@@ -61,9 +100,19 @@ Flow_Operator::~Flow_Operator(){
     delete A01;
     delete A10;
     delete A11;
+    delete density_table;
+    delete superlu_solver;
+    delete H_superlu;
+    delete H;
+    delete A10_A01;
+    delete S;
+    delete S_prec;
+    delete H_block;
+    delete H_prec;
 }
 
 Artic_sea::~Artic_sea(){
+    finish_checkpoints();
     delete pmesh;
     delete fec_H1;
     delete fec_ND;
@@ -82,5 +131,8 @@ Artic_sea::~Artic_sea(){
     delete flow_oper;
     delete ode_solver;
     delete paraview_out;
+    delete raster_out;
+    delete probes;
+    if (diagnostics_operation != MPI_OP_NULL) MPI_Op_free(&diagnostics_operation);
     if (config.master) cout << "Memory deleted \n";
 }
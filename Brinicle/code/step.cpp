@@ -8,47 +8,52 @@ void Artic_sea::time_step(){
     dt = min(dt, config.t_final - t);
 
     //Perform the time_step
+    start_telemetry();
     transport_oper->SetParameters(X, *rVelocity);
-    ode_solver->Step(X, t, dt);
+    {
+        Region_Timer timer(REGION_ARKODE);
+        ode_solver->Step(X, t, dt);
+    }
 
     flow_oper->SetParameters(X);
     flow_oper->Solve(Y, *Velocity, *rVelocity);
+    count_telemetry();
+
+    //Probes of the new state
+    probes->Sample(t, flow_oper->GetTemperature(), flow_oper->GetSalinity(), flow_oper->GetVelocity());
+
+    //In-situ diagnostics of the new state
+    if (config.diagnostics_steps > 0 && (last || iteration % config.diagnostics_steps == 0))
+        compute_diagnostics();
+
+    //Accumulated time of the phases
+    if (config.timer_steps > 0 && iteration % config.timer_steps == 0)
+        print_timers();
+
+    //Print visualization at fixed times (before the mesh changes,
+    //as the dense output is lost when ARKODE is resized)
+    if (config.vis_time > 0.)
+        print_dense();
+
+    //Adapt the mesh to the new position of the interface
+    if (config.amr_steps > 0 && !last && iteration % config.amr_steps == 0)
+        refine_mesh(false);
 
     //Update visualization steps
     vis_steps = (dt == config.dt_init) ? config.vis_steps_max : int((config.dt_init/dt)*config.vis_steps_max);
 
-    //Print visualization on certain steps
-    if (last || vis_steps <= vis_iteration){
+    //Print visualization on certain steps (and the final state)
+    if (config.vis_time > 0.){
+        if (last && vis_time_printed != t){
+            vis_print++;
+            print_fields(t, X, Y, *Velocity, *rVelocity);
+        }
+    } else if (last || vis_steps <= vis_iteration){
         //Update parameters
         vis_iteration = 0;
         vis_print++;
 
-        //Update information
-        temperature->Distribute(X.GetBlock(0));
-        salinity->Distribute(X.GetBlock(1));
-        vorticity->Distribute(Y.GetBlock(0));
-        stream->Distribute(Y.GetBlock(1));
-        velocity->Distribute(Velocity);
-        rvelocity->Distribute(rVelocity);
-        
-        //Calculate phases
-        for (int ii = 0; ii < phase->Size(); ii++)
-            (*phase)(ii) = Phase((*temperature)(ii), (*salinity)(ii));
-    
-        //Adimentionalize stream function
-        if (config.rescale){
-            double stream_local_max = stream->Max(), stream_max;
-            double stream_local_min = stream->Min(), stream_min;
-            MPI_Allreduce(&stream_local_max, &stream_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
-            MPI_Allreduce(&stream_local_min, &stream_min, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
-            for (int ii = 0; ii < stream->Size(); ii++)
-                    (*stream)(ii) = ((*stream)(ii)-stream_min)/(stream_max-stream_min);
-        }
-
-        //Print fields
-        paraview_out->SetCycle(vis_print);
-        paraview_out->SetTime(t);
-        paraview_out->Save();
+        print_fields(t, X, Y, *Velocity, *rVelocity);
     }
 
     //Print the system state
@@ -63,32 +68,107 @@ void Artic_sea::time_step(){
              << progress << "\r";
         cout.flush();
 
-        std::ofstream out;
-        out.open("results/progress.txt", std::ios::app);
-        out << left << setw(12)
-            << iteration << setw(12)
-            << dt << setw(12)
-            << t  << setw(12)
-            << progress << "\n";
-        out.close();
+        std::ostringstream line;
+        line << left << setw(12)
+             << iteration << setw(12)
+             << dt << setw(12)
+             << t  << setw(12)
+             << progress << "\n";
+        record_telemetry(line.str());
     }
 }
 
+//Print the visualization times reached by the last step, the state
+//between steps comes from the interpolation of ARKODE (no step is
+//shortened). The flow of the step is kept, unless it is requested to
+//solve it again for the interpolated state
+void Artic_sea::print_dense(){
+    Region_Timer timer(REGION_OUTPUT);
+    double tolerance = 1e-8*config.dt_init;
+    while (vis_time_next <= t + tolerance){
+        vis_print++;
+        if (vis_time_next >= t - tolerance){
+            print_fields(t, X, Y, *Velocity, *rVelocity);
+        } else {
+            //The work vectors only change size after the mesh is adapted
+            X_dense.Update(block_offsets_H1);
+            SundialsNVector dky(MPI_COMM_WORLD, X_dense.GetData(), X_dense.Size(), 2*fespace_H1->GlobalTrueVSize());
+            int flag = ARKStepGetDky(arkode->GetMem(), vis_time_next, 0, dky);
+            MFEM_VERIFY(flag == ARK_SUCCESS, "ARKStepGetDky failed with flag " << flag);
+
+            if (config.dense_flow){
+                Y_dense.Update(block_offsets_H1);
+                Velocity_dense.SetSize(Velocity->Size());
+                rVelocity_dense.SetSize(rVelocity->Size());
+                Y_dense = Y;
+                flow_oper->SetParameters(X_dense);
+                flow_oper->Solve(Y_dense, Velocity_dense, rVelocity_dense);
+                print_fields(vis_time_next, X_dense, Y_dense, Velocity_dense, rVelocity_dense);
+            } else {
+                print_fields(vis_time_next, X_dense, Y, *Velocity, *rVelocity);
+            }
+        }
+        vis_time_next += config.vis_time;
+    }
+}
+
+//Print the requested fields, the derived ones (phase, rescaled 
+//stream and velocities) are only calculated if they are printed
+void Artic_sea::print_fields(double time, const BlockVector &X_vis, const BlockVector &Y_vis, const Vector &Velocity_vis, const Vector &rVelocity_vis){
+    Region_Timer timer(REGION_OUTPUT);
+    vis_time_printed = time;
+
+    temperature->Distribute(X_vis.GetBlock(0));
+    salinity->Distribute(X_vis.GetBlock(1));
+    vorticity->Distribute(Y_vis.GetBlock(0));
+    stream->Distribute(Y_vis.GetBlock(1));
+    if (paraview_out->Requested("Velocity")) velocity->Distribute(Velocity_vis);
+    if (paraview_out->Requested("rVelocity")) rvelocity->Distribute(rVelocity_vis);
+    
+    //Calculate phases
+    if (paraview_out->Requested("Phase")){
+        Property_Fields fields;
+        fields.phase = phase->GetData();
+        Region_Timer timer(REGION_MATERIALS);
+        MaterialProperties(phase->Size(), temperature->GetData(), salinity->GetData(), fields);
+    }
+
+    //Adimentionalize stream function
+    if (config.rescale && paraview_out->Requested("Stream")){
+        double stream_local_max = stream->Max(), stream_max;
+        double stream_local_min = stream->Min(), stream_min;
+        MPI_Allreduce(&stream_local_max, &stream_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        MPI_Allreduce(&stream_local_min, &stream_min, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+        for (int ii = 0; ii < stream->Size(); ii++)
+                (*stream)(ii) = ((*stream)(ii)-stream_min)/(stream_max-stream_min);
+    }
+
+    //Print fields, the full output only on some of the prints
+    if (raster_out) raster_out->Save(vis_print, time);
+    if (last || vis_print % max(config.full_output, 1) == 0)
+        paraview_out->Save(vis_print, time);
+}
+
 //Update of the solver on each iteration
 void Transport_Operator::SetParameters(const BlockVector &X, const Vector &rVelocity){
+    Region_Timer timer(REGION_TRANSPORT_ASSEMBLY);
+
     //Recover current information
     temperature.SetFromTrueDofs(X.GetBlock(0));
     salinity.SetFromTrueDofs(X.GetBlock(1));
     rvelocity.SetFromTrueDofs(rVelocity); 
+    jacobian_outdated = true;
 
     //Associate the values of each auxiliar function
-    for (int ii = 0; ii < phase.Size(); ii++){
-        heat_inertia(ii) = HeatInertia(temperature(ii), salinity(ii));
-        heat_diffusivity(ii) = HeatDiffusivity(temperature(ii), salinity(ii));
-        salt_diffusivity(ii) = SaltDiffusivity(temperature(ii), salinity(ii));
-
-        phase(ii) = Phase(temperature(ii), salinity(ii));
-        temperature(ii) = temperature(ii) - FusionPoint(salinity(ii));
+    Property_Fields fields;
+    fields.heat_inertia = heat_inertia.GetData();
+    fields.heat_diffusivity = heat_diffusivity.GetData();
+    fields.salt_diffusivity = salt_diffusivity.GetData();
+    fields.phase = phase.GetData();
+    fields.temperature = temperature.GetData();
+    {
+        Region_Timer timer(REGION_MATERIALS);
+        MaterialProperties(phase.Size(), temperature.GetData(), salinity.GetData(), fields);
     }
 
     //Set the associated coefficients
@@ -120,6 +200,11 @@ void Transport_Operator::SetParameters(const BlockVector &X, const Vector &rVelo
     coeff_rMV.SetBCoef(coeff_rV);
 
     //Create corresponding bilinear forms
+    if (config.partial_assembly){
+        SetPartialAssembly();
+        return;
+    }
+
     if (M0) delete M0;
     if (M0_e) delete M0_e;
     if (M0_o) delete M0_o;
@@ -131,7 +216,6 @@ void Transport_Operator::SetParameters(const BlockVector &X, const Vector &rVelo
     M0_e = M0->EliminateRowsCols(ess_tdof_0);
     M0_o = m0.ParallelAssemble();
 
-    M0_prec.SetOperator(*M0);
     M0_solver.SetOperator(*M0);
 
     //Create transport matrix
@@ -152,20 +236,84 @@ void Transport_Operator::SetParameters(const BlockVector &X, const Vector &rVelo
     K1 = k1.ParallelAssemble();
 }
 
+//Matrix-free version of the bilinear forms, the coefficients are
+//evaluated at the quadrature points during the assembly
+void Transport_Operator::SetPartialAssembly(){
+
+    //Create mass operator
+    if (m0_pa) delete m0_pa;
+    m0_pa = new ParBilinearForm(&fespace_H1);
+    m0_pa->SetAssemblyLevel(AssemblyLevel::PARTIAL);
+    m0_pa->AddDomainIntegrator(new MassIntegrator(coeff_rM));
+    m0_pa->Assemble();
+    m0_pa->FormSystemMatrix(ess_tdof_0, M0_pa);
+    m0_pa->FormSystemMatrix(ess_tdof_none, M0_o_pa);
+    M0_diag.SetSize(fespace_H1.GetTrueVSize());
+    m0_pa->AssembleDiagonal(M0_diag);
+
+    if (M0_pa_prec) delete M0_pa_prec;
+    M0_pa_prec = new OperatorJacobiSmoother(M0_diag, ess_tdof_0);
+    M0_pa_solver.SetPreconditioner(*M0_pa_prec);
+    M0_pa_solver.SetOperator(*M0_pa);
+
+    //Create transport operators, the diagonal used for the
+    //preconditioner only includes the diffusion term
+    if (K0_pa) delete K0_pa;
+    if (k0_pa) delete k0_pa;
+    if (c0_pa) delete c0_pa;
+    k0_pa = new ParBilinearForm(&fespace_H1);
+    k0_pa->SetAssemblyLevel(AssemblyLevel::PARTIAL);
+    k0_pa->AddDomainIntegrator(new DiffusionIntegrator(coeff_rD0));
+    k0_pa->Assemble();
+    k0_pa->FormSystemMatrix(ess_tdof_none, K0_d_pa);
+    K0_diag.SetSize(fespace_H1.GetTrueVSize());
+    k0_pa->AssembleDiagonal(K0_diag);
+
+    c0_pa = new ParBilinearForm(&fespace_H1);
+    c0_pa->SetAssemblyLevel(AssemblyLevel::PARTIAL);
+    c0_pa->AddDomainIntegrator(new ConvectionIntegrator(coeff_rMV));
+    c0_pa->Assemble();
+    c0_pa->FormSystemMatrix(ess_tdof_none, K0_c_pa);
+    K0_pa = new SumOperator(K0_d_pa.Ptr(), 1., K0_c_pa.Ptr(), 1., false, false);
+
+    if (K1_pa) delete K1_pa;
+    if (k1_pa) delete k1_pa;
+    if (c1_pa) delete c1_pa;
+    k1_pa = new ParBilinearForm(&fespace_H1);
+    k1_pa->SetAssemblyLevel(AssemblyLevel::PARTIAL);
+    k1_pa->AddDomainIntegrator(new DiffusionIntegrator(coeff_rD1));
+    k1_pa->Assemble();
+    k1_pa->FormSystemMatrix(ess_tdof_none, K1_d_pa);
+    K1_diag.SetSize(fespace_H1.GetTrueVSize());
+    k1_pa->AssembleDiagonal(K1_diag);
+
+    c1_pa = new ParBilinearForm(&fespace_H1);
+    c1_pa->SetAssemblyLevel(AssemblyLevel::PARTIAL);
+    c1_pa->AddDomainIntegrator(new ConvectionIntegrator(coeff_rV));
+    c1_pa->Assemble();
+    c1_pa->FormSystemMatrix(ess_tdof_none, K1_c_pa);
+    K1_pa = new SumOperator(K1_d_pa.Ptr(), 1., K1_c_pa.Ptr(), 1., false, false);
+
+    //The previous Jacobian refers to the old operators
+    if (T0_pa) SetPartialAssemblyJacobian(setup_dt);
+}
+
 //Update of the solver on each iteration
 void Flow_Operator::SetParameters(const BlockVector &X){
+    Region_Timer timer(REGION_FLOW_ASSEMBLY);
 
     //Recover current information
     temperature.SetFromTrueDofs(X.GetBlock(0));
     salinity.SetFromTrueDofs(X.GetBlock(1));
 
     //Calculate impermeability and density coefficients
-    for (int ii = 0; ii < impermeability.Size(); ii++){
-        double T = temperature(ii);
-        double S = salinity(ii);
-
-        impermeability(ii) = Impermeability(T, S);
-        density(ii) = Density(T, S);
+    Property_Fields fields;
+    fields.impermeability = impermeability.GetData();
+    fields.density = density.GetData();
+    fields.density_table = density_table;
+    {
+        Region_Timer timer(REGION_MATERIALS);
+        MaterialProperties(impermeability.Size(), temperature.GetData(), salinity.GetData(), fields);
     }
     
     //Calculate gradient of the density field
@@ -180,16 +328,10 @@ void Flow_Operator::SetParameters(const BlockVector &X){
     ConstantCoefficient coeff_buoyancy_constant(constants.BuoyancyCoefficient);
     ProductCoefficient coeff_buoyancy(coeff_buoyancy_constant, coeff_density_dr);
     ProductCoefficient coeff_r_buoyancy(coeff_r, coeff_buoyancy);
-    
-    //Apply boundary conditions
-    vorticity_boundary.ProjectCoefficient(coeff_vorticity);
-    vorticity_boundary.ProjectBdrCoefficient(coeff_vorticity, ess_bdr_0);
 
-    stream_boundary.ProjectCoefficient(coeff_stream);
-    stream_boundary.ProjectBdrCoefficient(coeff_stream_in, ess_bdr_in);
-    stream_boundary.ProjectBdrCoefficient(coeff_stream_out, ess_bdr_out);
-    stream_boundary.ProjectBdrCoefficient(coeff_stream_closed_down, ess_bdr_closed_down);
-    stream_boundary.ProjectBdrCoefficient(coeff_stream_closed_up, ess_bdr_closed_up);
+    //Only the forms that depend on (T,S) are assembled, the 
+    //boundary conditions, A00, A01 and A10 (along with its
+    //contribution to b1) are fixed in the constructor
 
     //Define non-constant RHS
     if (B1) delete B1;
@@ -207,15 +349,7 @@ void Flow_Operator::SetParameters(const BlockVector &X){
     a11.Finalize();
     A11 = a11.ParallelAssemble();
 
-    if (A10) delete A10;
-    ParMixedBilinearForm a10(&fespace_H1, &fespace_H1);
-    a10.AddDomainIntegrator(new MixedGradGradIntegrator);
-    a10.AddDomainIntegrator(new MixedDirectionalDerivativeIntegrator(coeff_r_inv_hat));
-    a10.Assemble();
-    a10.EliminateTrialDofs(ess_bdr_0, vorticity_boundary, b1);
-    a10.EliminateTestDofs(ess_bdr_1);    
-    a10.Finalize();
-    A10 = a10.ParallelAssemble();
+    b1 += b1_boundary;
 
     //Transfer to TrueDofs
     B1 = b1.ParallelAssemble();
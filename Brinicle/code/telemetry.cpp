@@ -0,0 +1,88 @@
+#include "header.h"
+
+/****
+ * Per-step telemetry of the solvers (results/telemetry.txt, one JSON
+ * object per line) with the ARKODE counters of the step, the linear
+ * solves of the transport (M0, M1, T0, T1) and flow systems and the
+ * wall time. The master keeps the records (and the lines of
+ * results/progress.txt) in memory and appends them periodically
+ ****/
+static const size_t telemetry_size = 1 << 16;
+static const double telemetry_period = 10.;
+static const char *linear_names[5] = {"M0", "M1", "T0", "T1", "Flow"};
+
+//Cumulative counters of ARKODE: steps, step attempts, error test
+//failures, nonlinear iterations, nonlinear convergence failures and
+//linear solver setups
+static void ARKodeCounters(void *arkode_mem, long *counters){
+    ARKStepGetNumSteps(arkode_mem, &counters[0]);
+    ARKStepGetNumStepAttempts(arkode_mem, &counters[1]);
+    ARKStepGetNumErrTestFails(arkode_mem, &counters[2]);
+    ARKStepGetNumNonlinSolvIters(arkode_mem, &counters[3]);
+    ARKStepGetNumNonlinSolvConvFails(arkode_mem, &counters[4]);
+    ARKStepGetNumLinSolvSetups(arkode_mem, &counters[5]);
+}
+
+//Counters before the step
+void Artic_sea::start_telemetry(){
+    telemetry_start = MPI_Wtime();
+    ARKodeCounters(arkode->GetMem(), telemetry_counters);
+    transport_oper->ResetLinearStatistics();
+    flow_oper->ResetLinearStatistics();
+}
+
+//Solver statistics of the step (before the mesh adaptation solves
+//the flow again)
+void Artic_sea::count_telemetry(){
+    long counters[6];
+    ARKodeCounters(arkode->GetMem(), counters);
+    for (int ii = 0; ii < 6; ii++)
+        telemetry_counters[ii] = counters[ii] - telemetry_counters[ii];
+
+    const Linear_Statistics *transport = transport_oper->GetLinearStatistics();
+    for (int ii = 0; ii < 4; ii++)
+        telemetry_linear[ii] = transport[ii];
+    telemetry_linear[4] = flow_oper->GetLinearStatistics();
+}
+
+//Keep the record of the step and its line of progress
+void Artic_sea::record_telemetry(const string &progress){
+    if (!config.master) return;
+
+    char line[512];
+    snprintf(line, sizeof(line),
+             "{\"step\": %d, \"time\": %.10g, \"dt\": %.6g, \"wall\": %.6g, "
+             "\"nonlinear_iterations\": %ld, \"nonlinear_failures\": %ld, \"linear_setups\": %ld, "
+             "\"error_test_failures\": %ld, \"rejected_steps\": %ld",
+             iteration, t, dt, MPI_Wtime() - telemetry_start,
+             telemetry_counters[3], telemetry_counters[4], telemetry_counters[5],
+             telemetry_counters[2], telemetry_counters[1] - telemetry_counters[0]);
+    telemetry_buffer += line;
+    for (int ii = 0; ii < 5; ii++){
+        snprintf(line, sizeof(line), ", \"%s\": {\"solves\": %d, \"iterations\": %d, \"residual\": %.3e}",
+                 linear_names[ii], telemetry_linear[ii].solves, telemetry_linear[ii].iterations, telemetry_linear[ii].residual);
+        telemetry_buffer += line;
+    }
+    telemetry_buffer += "}\n";
+    progress_buffer += progress;
+
+    if (last || telemetry_buffer.size() > telemetry_size || MPI_Wtime() - telemetry_flush > telemetry_period)
+        flush_telemetry();
+}
+
+//Append the buffers to their files
+void Artic_sea::flush_telemetry(){
+    telemetry_flush = MPI_Wtime();
+    if (!config.master) return;
+
+    std::ofstream out;
+    out.open("results/telemetry.txt", std::ios::app);
+    out << telemetry_buffer;
+    out.close();
+    telemetry_buffer.clear();
+
+    out.open("results/progress.txt", std::ios::app);
+    out << progress_buffer;
+    out.close();
+    progress_buffer.clear();
+}
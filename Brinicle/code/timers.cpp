@@ -0,0 +1,122 @@
+#include "header.h"
+
+//Exclusive time of each region and innermost timer of the thread
+static thread_local double region_time[REGION_COUNT] = {0.};
+static thread_local double region_counts[REGION_COUNT][HARDWARE_COUNTERS] = {{0.}};
+static thread_local Region_Timer *active_timer = NULL;
+static thread_local int active_region = -1;
+
+static const char *region_names[REGION_COUNT] = {
+    "ARKODE (own work)",
+    "Material properties",
+    "Transport assembly",
+    "AMG setup",
+    "Transport solver",
+    "Flow assembly",
+    "Flow solver",
+    "Velocity projection",
+    "Mesh adaptation",
+    "Output",
+    "Diagnostics and probes",
+    "Checkpoints"
+};
+
+const char *RegionName(int region){
+    return region_names[region];
+}
+
+double RegionTime(int region){
+    return region_time[region];
+}
+
+//Innermost region of the thread (-1 outside of them) and names of
+//the regions, the phases of the MPI calls in the profiler
+//(MPI_Profiler/pmpi.cpp)
+extern "C" int CurrentRegion(){
+    return active_region;
+}
+
+extern "C" const char *ProfilerRegionName(int region){
+    return (region >= 0 && region < REGION_COUNT) ? region_names[region] : NULL;
+}
+
+//Start the timer inside the current one (if any)
+Region_Timer::Region_Timer(Region region):
+    region(region),
+    start(MPI_Wtime()),
+    nested(0.),
+    parent(active_timer)
+{
+    active_timer = this;
+    active_region = region;
+    if (counters_enabled){
+        ReadCounters(counts);
+        for (int ii = 0; ii < HARDWARE_COUNTERS; ii++)
+            nested_counts[ii] = 0.;
+    }
+}
+
+//Only the time outside of the nested timers is added
+Region_Timer::~Region_Timer(){
+    double end = MPI_Wtime();
+    double elapsed = end - start;
+    region_time[region] += elapsed - nested;
+    if (trace_enabled) TraceEvent(region_names[region], start, end);
+    if (parent) parent->nested += elapsed;
+    active_timer = parent;
+    active_region = parent ? parent->region : -1;
+
+    if (counters_enabled){
+        double current[HARDWARE_COUNTERS];
+        ReadCounters(current);
+        for (int ii = 0; ii < HARDWARE_COUNTERS; ii++){
+            double delta = current[ii] - counts[ii];
+            region_counts[region][ii] += delta - nested_counts[ii];
+            if (parent) parent->nested_counts[ii] += delta;
+        }
+    }
+}
+
+//Minimum, maximum and average time of the regions over the processors
+void RegionStatistics(double *minimum, double *maximum, double *average){
+    double local[REGION_COUNT];
+    for (int ii = 0; ii < REGION_COUNT; ii++)
+        local[ii] = region_time[ii];
+
+    int nproc;
+    MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+    MPI_Allreduce(local, minimum, REGION_COUNT, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(local, maximum, REGION_COUNT, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(local, average, REGION_COUNT, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    for (int ii = 0; ii < REGION_COUNT; ii++)
+        average[ii] /= nproc;
+}
+
+//Hardware counts of the regions summed over the processors
+void RegionCounters(double *total){
+    MPI_Allreduce(&region_counts[0][0], total, REGION_COUNT*HARDWARE_COUNTERS, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+}
+
+//Append the accumulated times (average and maximum) to results/timers.txt
+void Artic_sea::print_timers(){
+    double minimum[REGION_COUNT], maximum[REGION_COUNT], average[REGION_COUNT];
+    RegionStatistics(minimum, maximum, average);
+
+    if (config.master){
+        std::ofstream out;
+        bool header = (timer_prints == 0 && !config.restart);
+        out.open("results/timers.txt", header ? std::ios::trunc : std::ios::app);
+        if (header){
+            out << "Iteration,Time";
+            for (int ii = 0; ii < REGION_COUNT; ii++)
+                out << "," << RegionName(ii) << " (avg)," << RegionName(ii) << " (max)";
+            out << "\n";
+        }
+        out << iteration << "," << t;
+        for (int ii = 0; ii < REGION_COUNT; ii++)
+            out << "," << average[ii] << "," << maximum[ii];
+        out << "\n";
+        out.close();
+    }
+    timer_prints++;
+}
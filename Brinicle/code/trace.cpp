@@ -0,0 +1,120 @@
+#include "header.h"
+#include <mutex>
+
+/****
+ * Timeline of the execution (results/trace.json, Chrome trace events).
+ * Each thread records its spans in its own ring buffer (the oldest
+ * spans are overwritten), so no locks are taken while recording. The
+ * buffers of finished threads are reused by the next ones. At the end
+ * all the buffers are gathered by the master, with one process per
+ * rank and one track per thread
+ ****/
+bool trace_enabled = false;
+static const long trace_capacity = 1 << 16;
+static double trace_origin = 0.;
+
+struct Trace_Event{
+    const char *name;
+    double start;
+    double end;
+};
+
+struct Trace_Buffer{
+    std::vector<Trace_Event> events;
+    long count;
+    int id;
+};
+
+//Buffers of all the threads and the ones released by finished threads
+static std::mutex trace_mutex;
+static std::vector<Trace_Buffer*> trace_buffers;
+static std::vector<Trace_Buffer*> trace_free;
+
+//Buffer of the current thread, released when the thread finishes
+struct Trace_Thread{
+    Trace_Buffer *buffer = NULL;
+    ~Trace_Thread(){
+        if (!buffer) return;
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        trace_free.push_back(buffer);
+    }
+};
+static thread_local Trace_Thread trace_thread;
+
+//Take a buffer for the current thread (only on its first span)
+static Trace_Buffer *trace_buffer(){
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    if (!trace_free.empty()){
+        Trace_Buffer *buffer = trace_free.back();
+        trace_free.pop_back();
+        return buffer;
+    }
+    Trace_Buffer *buffer = new Trace_Buffer;
+    buffer->events.resize(trace_capacity);
+    buffer->count = 0;
+    buffer->id = trace_buffers.size();
+    trace_buffers.push_back(buffer);
+    return buffer;
+}
+
+//Record a span of the current thread
+void TraceEvent(const char *name, double start, double end){
+    Trace_Buffer *&buffer = trace_thread.buffer;
+    if (!buffer) buffer = trace_buffer();
+    buffer->events[buffer->count % trace_capacity] = {name, start, end};
+    buffer->count++;
+}
+
+//Enable the tracing with a common origin of time for all the ranks
+void StartTrace(){
+    MPI_Barrier(MPI_COMM_WORLD);
+    trace_thread.buffer = trace_buffer();
+    trace_origin = MPI_Wtime();
+    trace_enabled = true;
+}
+
+//Gather the spans of all the ranks and print them (the other threads
+//must have finished)
+void WriteTrace(const string &file){
+    int pid, nproc;
+    MPI_Comm_rank(MPI_COMM_WORLD, &pid);
+    MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+    trace_enabled = false;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": " << pid
+        << ", \"args\": {\"name\": \"Rank " << pid << "\"}},\n";
+    for (Trace_Buffer *buffer : trace_buffers){
+        long first = max(0L, buffer->count - trace_capacity);
+        out << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": " << pid << ", \"tid\": " << buffer->id
+            << ", \"args\": {\"name\": \"" << (buffer->id == 0 ? "Main" : "Thread " + to_string(buffer->id))
+            << (first > 0 ? " (" + to_string(first) + " spans lost)" : "") << "\"}},\n";
+        for (long ii = first; ii < buffer->count; ii++){
+            const Trace_Event &event = buffer->events[ii % trace_capacity];
+            out << "{\"ph\": \"X\", \"name\": \"" << event.name << "\", \"pid\": " << pid << ", \"tid\": " << buffer->id
+                << ", \"ts\": " << 1E6*(event.start - trace_origin) << ", \"dur\": " << 1E6*(event.end - event.start) << "},\n";
+        }
+    }
+    string local = out.str();
+
+    //Events of all the ranks in the master
+    int size = local.size();
+    std::vector<int> sizes(nproc), displs(nproc);
+    MPI_Gather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    string global;
+    if (pid == 0){
+        for (int ii = 1; ii < nproc; ii++)
+            displs[ii] = displs[ii - 1] + sizes[ii - 1];
+        global.resize(displs[nproc - 1] + sizes[nproc - 1]);
+    }
+    MPI_Gatherv(&local[0], size, MPI_CHAR, &global[0], sizes.data(), displs.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (pid == 0){
+        //Remove the last comma
+        global.resize(global.size() - 2);
+        std::ofstream trace(file.c_str(), std::ios::trunc);
+        trace << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" << global << "\n]}\n";
+        trace.close();
+    }
+}
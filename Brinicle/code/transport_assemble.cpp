@@ -31,9 +31,26 @@ Transport_Operator::Transport_Operator(Config config, ParFiniteElementSpace &fes
     B0(NULL), B1(NULL), 
     B0_dt(&fespace_H1), B1_dt(&fespace_H1),
     Z0(&fespace_H1), Z1(&fespace_H1),
+    X0_view(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets()),
+    X1_view(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets()),
+    Y0_view(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets()),
+    Y1_view(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets()),
+    callback_allocations(0),
+    jacobian_outdated(true), jacobian_setups(0), jacobian_skipped(0),
     M0_solver(MPI_COMM_WORLD), M1_solver(MPI_COMM_WORLD), 
-    T0_solver(MPI_COMM_WORLD), T1_solver(MPI_COMM_WORLD)
+    T0_solver(MPI_COMM_WORLD), T1_solver(MPI_COMM_WORLD),
+    m0_pa(NULL), m1_pa(NULL),
+    k0_pa(NULL), k1_pa(NULL),
+    c0_pa(NULL), c1_pa(NULL),
+    K0_pa(NULL), K1_pa(NULL),
+    T0_pa(NULL), T1_pa(NULL), setup_dt(0.),
+    M0_pa_solver(MPI_COMM_WORLD), M1_pa_solver(MPI_COMM_WORLD),
+    T0_pa_solver(MPI_COMM_WORLD), T1_pa_solver(MPI_COMM_WORLD),
+    M0_pa_prec(NULL), M1_pa_prec(NULL),
+    T0_pa_prec(NULL), T1_pa_prec(NULL)
 {
+    ResetLinearStatistics();
+
     /****
      * Define essential boundary conditions
      * 
@@ -67,44 +84,11 @@ Transport_Operator::Transport_Operator(Config config, ParFiniteElementSpace &fes
     ess_bdr_1 [4] = 1;     ess_bdr_1 [5] = 0;
     fespace_H1.GetEssentialTrueDofs(ess_bdr_1, ess_tdof_1);
 
-    if (!config.restart){
-        //Apply initial conditions
-        FunctionCoefficient coeff_initial_temperature(initial_temperature_f);
-        ConstantCoefficient coeff_boundary_temperature(InflowTemperature);
-        temperature.ProjectCoefficient(coeff_initial_temperature);
-        temperature.ProjectBdrCoefficient(coeff_boundary_temperature, ess_bdr_0);
-        temperature.GetTrueDofs(X.GetBlock(0));
-        
-        FunctionCoefficient coeff_initial_salinity(initial_salinity_f);
-        ConstantCoefficient coeff_boundary_salinity(InflowSalinity);
-        salinity.ProjectCoefficient(coeff_initial_salinity);
-        salinity.ProjectBdrCoefficient(coeff_boundary_salinity, ess_bdr_1);
-        salinity.GetTrueDofs(X.GetBlock(1));
-    }
-
-    //Create mass matrix                                   
-    ParBilinearForm m1(&fespace_H1);                 
-    m1.AddDomainIntegrator(new MassIntegrator(coeff_r));  
-    m1.Assemble();                                        
-    m1.Finalize();                                        
-    M1 = m1.ParallelAssemble();
-    M1_e = M1->EliminateRowsCols(ess_tdof_1);
-    M1_o = m1.ParallelAssemble();
-
-    //Set RHS
-    ConstantCoefficient Zero(0.);
-    ParLinearForm b0(&fespace_H1);
-    b0.AddDomainIntegrator(new DomainLFIntegrator(Zero));
-    b0.Assemble();
-    B0 = b0.ParallelAssemble();
-
-    ParLinearForm b1(&fespace_H1);
-    b1.AddDomainIntegrator(new DomainLFIntegrator(Zero));
-    b1.Assemble();
-    B1 = b1.ParallelAssemble();
+    if (!config.restart) SetInitialConditions(X);
 
     //Configure M solver
     M0_prec.SetPrintLevel(0);
+    M0_prec.SetReuse(config.amg_reuse);
     M0_solver.SetTol(config.reltol_conduction);
     M0_solver.SetAbsTol(config.abstol_conduction);
     M0_solver.SetMaxIter(config.iter_conduction);
@@ -112,16 +96,15 @@ Transport_Operator::Transport_Operator(Config config, ParFiniteElementSpace &fes
     M0_solver.SetPreconditioner(M0_prec);
 
     M1_prec.SetPrintLevel(0);
-    M1_prec.SetOperator(*M1);
     M1_solver.SetTol(config.reltol_conduction);
     M1_solver.SetAbsTol(config.abstol_conduction);
     M1_solver.SetMaxIter(config.iter_conduction);
     M1_solver.SetPrintLevel(0);
     M1_solver.SetPreconditioner(M1_prec);
-    M1_solver.SetOperator(*M1); 
 
     //Configure T solver 
     T0_prec.SetPrintLevel(0);
+    T0_prec.SetReuse(config.amg_reuse);
     T0_solver.SetTol(config.reltol_conduction);
     T0_solver.SetAbsTol(config.abstol_conduction);
     T0_solver.SetMaxIter(config.iter_conduction); 
@@ -129,11 +112,153 @@ Transport_Operator::Transport_Operator(Config config, ParFiniteElementSpace &fes
     T0_solver.SetPreconditioner(T0_prec);         
                                                   
     T1_prec.SetPrintLevel(0);                     
+    T1_prec.SetReuse(config.amg_reuse);
     T1_solver.SetTol(config.reltol_conduction);   
     T1_solver.SetAbsTol(config.abstol_conduction);
     T1_solver.SetMaxIter(config.iter_conduction); 
     T1_solver.SetPrintLevel(0);                   
     T1_solver.SetPreconditioner(T1_prec);
+
+    //Configure partial assembly solvers, the Jacobi 
+    //preconditioners are created along with the operators. The
+    //mass matrices are SPD (CG), the Jacobians have the convection
+    //term and are nonsymmetric (GMRES)
+    M0_pa_solver.SetRelTol(config.reltol_conduction);
+    M0_pa_solver.SetAbsTol(config.abstol_conduction);
+    M0_pa_solver.SetMaxIter(config.iter_conduction);
+    M0_pa_solver.SetPrintLevel(0);
+
+    M1_pa_solver.SetRelTol(config.reltol_conduction);
+    M1_pa_solver.SetAbsTol(config.abstol_conduction);
+    M1_pa_solver.SetMaxIter(config.iter_conduction);
+    M1_pa_solver.SetPrintLevel(0);
+
+    T0_pa_solver.SetRelTol(config.reltol_conduction);
+    T0_pa_solver.SetAbsTol(config.abstol_conduction);
+    T0_pa_solver.SetMaxIter(config.iter_conduction);
+    T0_pa_solver.SetPrintLevel(0);
+
+    T1_pa_solver.SetRelTol(config.reltol_conduction);
+    T1_pa_solver.SetAbsTol(config.abstol_conduction);
+    T1_pa_solver.SetMaxIter(config.iter_conduction);
+    T1_pa_solver.SetPrintLevel(0);
+
+    AssembleConstant();
+}
+
+//Apply the initial conditions on the current mesh
+void Transport_Operator::SetInitialConditions(BlockVector &X){
+    FunctionCoefficient coeff_initial_temperature(initial_temperature_f);
+    ConstantCoefficient coeff_boundary_temperature(InflowTemperature);
+    temperature.ProjectCoefficient(coeff_initial_temperature);
+    temperature.ProjectBdrCoefficient(coeff_boundary_temperature, ess_bdr_0);
+    temperature.GetTrueDofs(X.GetBlock(0));
+    
+    FunctionCoefficient coeff_initial_salinity(initial_salinity_f);
+    ConstantCoefficient coeff_boundary_salinity(InflowSalinity);
+    salinity.ProjectCoefficient(coeff_initial_salinity);
+    salinity.ProjectBdrCoefficient(coeff_boundary_salinity, ess_bdr_1);
+    salinity.GetTrueDofs(X.GetBlock(1));
+}
+
+//Operators that do not depend on (T,S): the salinity mass matrix and the RHS
+void Transport_Operator::AssembleConstant(){
+
+    //Create mass matrix
+    if (!config.partial_assembly){
+        ParBilinearForm m1(&fespace_H1);
+        m1.AddDomainIntegrator(new MassIntegrator(coeff_r));
+        m1.Assemble();
+        m1.Finalize();
+        M1 = m1.ParallelAssemble();
+        M1_e = M1->EliminateRowsCols(ess_tdof_1);
+        M1_o = m1.ParallelAssemble();
+    } else {
+        m1_pa = new ParBilinearForm(&fespace_H1);
+        m1_pa->SetAssemblyLevel(AssemblyLevel::PARTIAL);
+        m1_pa->AddDomainIntegrator(new MassIntegrator(coeff_r));
+        m1_pa->Assemble();
+        m1_pa->FormSystemMatrix(ess_tdof_1, M1_pa);
+        m1_pa->FormSystemMatrix(ess_tdof_none, M1_o_pa);
+        M1_diag.SetSize(fespace_H1.GetTrueVSize());
+        m1_pa->AssembleDiagonal(M1_diag);
+    }
+
+    //Set RHS
+    ConstantCoefficient Zero(0.);
+    ParLinearForm b0(&fespace_H1);
+    b0.AddDomainIntegrator(new DomainLFIntegrator(Zero));
+    b0.Assemble();
+    B0 = b0.ParallelAssemble();
+
+    ParLinearForm b1(&fespace_H1);
+    b1.AddDomainIntegrator(new DomainLFIntegrator(Zero));
+    b1.Assemble();
+    B1 = b1.ParallelAssemble();
+
+    //Set the operator of the M1 solver
+    if (!config.partial_assembly){
+        M1_solver.SetOperator(*M1); 
+    } else {
+        M1_pa_prec = new OperatorJacobiSmoother(M1_diag, ess_tdof_1);
+        M1_pa_solver.SetPreconditioner(*M1_pa_prec);
+        M1_pa_solver.SetOperator(*M1_pa);
+    }
+}
+
+//Adapt the operator to the spaces updated after a change of the mesh,
+//the solvers are kept and the matrices that depend on (T,S) are
+//assembled again by SetParameters
+void Transport_Operator::Update(const Array<int> &block_offsets_H1){
+    height = width = 2*fespace_H1.GetTrueVSize();
+    this->block_offsets_H1 = block_offsets_H1;
+    fespace_H1.GetEssentialTrueDofs(ess_bdr_0, ess_tdof_0);
+    fespace_H1.GetEssentialTrueDofs(ess_bdr_1, ess_tdof_1);
+
+    temperature.Update(); salinity.Update(); phase.Update();
+    rvelocity.Update();
+    heat_inertia.Update();
+    heat_diffusivity.Update();
+    salt_diffusivity.Update();
+
+    B0_dt = HypreParVector(&fespace_H1);
+    B1_dt = HypreParVector(&fespace_H1);
+    Z0 = HypreParVector(&fespace_H1);
+    Z1 = HypreParVector(&fespace_H1);
+    X0_view = HypreParVector(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets());
+    X1_view = HypreParVector(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets());
+    Y0_view = HypreParVector(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets());
+    Y1_view = HypreParVector(fespace_H1.GetComm(), fespace_H1.GlobalTrueVSize(), NULL, fespace_H1.GetTrueDofOffsets());
+
+    HypreParMatrix **matrices[12] = {&M0, &M1, &M0_e, &M1_e, &M0_o, &M1_o, &K0, &K1, &T0, &T1, &T0_e, &T1_e};
+    for (int ii = 0; ii < 12; ii++){
+        delete *matrices[ii];
+        *matrices[ii] = NULL;
+    }
+    delete B0; B0 = NULL;
+    delete B1; B1 = NULL;
+
+    ParBilinearForm **forms[6] = {&m0_pa, &m1_pa, &k0_pa, &k1_pa, &c0_pa, &c1_pa};
+    for (int ii = 0; ii < 6; ii++){
+        delete *forms[ii];
+        *forms[ii] = NULL;
+    }
+    delete K0_pa; K0_pa = NULL;
+    delete K1_pa; K1_pa = NULL;
+    delete T0_pa; T0_pa = NULL;
+    delete T1_pa; T1_pa = NULL;
+    delete M0_pa_prec; M0_pa_prec = NULL;
+    delete M1_pa_prec; M1_pa_prec = NULL;
+    delete T0_pa_prec; T0_pa_prec = NULL;
+    delete T1_pa_prec; T1_pa_prec = NULL;
+
+    //The hierarchies of the previous mesh can not be reused
+    M0_prec.Invalidate();
+    T0_prec.Invalidate();
+    T1_prec.Invalidate();
+    jacobian_outdated = true;
+
+    AssembleConstant();
 }
 
 //Initial conditions
@@ -1,96 +1,241 @@
 #include "header.h"
 
+//Add a solve to the statistics of its system
+static void RecordSolve(Linear_Statistics &statistics, int iterations, double residual){
+    statistics.solves++;
+    statistics.iterations += iterations;
+    statistics.residual = max(statistics.residual, residual);
+}
+
+//Statistics of the hypre solvers (relative residual)
+static void RecordSolve(Linear_Statistics &statistics, const HyprePCG &solver){
+    int iterations;
+    double residual;
+    solver.GetNumIterations(iterations);
+    solver.GetFinalResidualNorm(residual);
+    RecordSolve(statistics, iterations, residual);
+}
+
+//Statistics of the partial assembly solvers (relative to the RHS)
+static void RecordSolve(Linear_Statistics &statistics, const IterativeSolver &solver, const Vector &B){
+    double norm = sqrt(InnerProduct(MPI_COMM_WORLD, B, B));
+    RecordSolve(statistics, solver.GetNumIterations(), solver.GetFinalNorm()/max(norm, 1E-300));
+}
+
 //From  M(dX_dt) + K(X) = B
 //Solve M(dX_dt) + K(X) = B for dX_dt
 void Transport_Operator::Mult(const Vector &X, Vector &dX_dt) const{
+
+    Region_Timer timer(REGION_TRANSPORT_SOLVE);
+    long allocations = AllocationCount();
     
-    //Initialize the corresponding vectors
-    HypreParVector dX0_dt(&fespace_H1), dX1_dt(&fespace_H1);
-    HypreParVector X0(&fespace_H1),     X1(&fespace_H1);
-    for (int ii = block_offsets_H1[0]; ii < block_offsets_H1[1]; ii++)
-        X0(ii - block_offsets_H1[0]) = X(ii);
-    for (int ii = block_offsets_H1[1]; ii < block_offsets_H1[2]; ii++)
-        X1(ii - block_offsets_H1[1]) = X(ii);
-    Z0 = 0.;   Z1 = 0.;
-    dX0_dt = 0.; dX1_dt = 0.;
+    //Point the views to the blocks of X and dX_dt
     dX_dt = 0.;
+    Z0 = 0.;   Z1 = 0.;
+    X0_view.SetData(const_cast<double*>(X.GetData()) + block_offsets_H1[0]);
+    X1_view.SetData(const_cast<double*>(X.GetData()) + block_offsets_H1[1]);
+    Y0_view.SetData(dX_dt.GetData() + block_offsets_H1[0]);
+    Y1_view.SetData(dX_dt.GetData() + block_offsets_H1[1]);
+    HypreParVector &X0 = X0_view, &X1 = X1_view;
+    HypreParVector &dX0_dt = Y0_view, &dX1_dt = Y1_view;
+
+    if (!config.partial_assembly){
+        //Set up RHS
+        K0->Mult(-1., X0, 1., Z0);
+        Z0.Add(1., *B0);
+        EliminateBC(*M0, *M0_e, ess_tdof_0, dX0_dt, Z0);
 
-    //Set up RHS
-    K0->Mult(-1., X0, 1., Z0);
-    Z0.Add(1., *B0);
-    EliminateBC(*M0, *M0_e, ess_tdof_0, dX0_dt, Z0);
+        K1->Mult(-1., X1, 1., Z1);
+        Z1.Add(1., *B1);
+        EliminateBC(*M1, *M1_e, ess_tdof_1, dX1_dt, Z1);
 
-    K1->Mult(-1., X1, 1., Z1);
-    Z1.Add(1., *B1);
-    EliminateBC(*M1, *M1_e, ess_tdof_1, dX1_dt, Z1);
+        //Solve the system  
+        { Trace_Span span("M0 solve"); M0_solver.Mult(Z0, dX0_dt); }
+        { Trace_Span span("M1 solve"); M1_solver.Mult(Z1, dX1_dt); }
 
-    //Solve the system  
-    M0_solver.Mult(Z0, dX0_dt); M1_solver.Mult(Z1, dX1_dt); 
+        //Check the quality of the reused hierarchy
+        int iterations;
+        M0_solver.GetNumIterations(iterations); M0_prec.Monitor(iterations);
+        RecordSolve(linear_statistics[0], M0_solver);
+        RecordSolve(linear_statistics[1], M1_solver);
+    } else {
+        //Set up RHS (dX_dt vanishes on the essential dofs)
+        K0_pa->Mult(X0, Z0);
+        Z0.Neg();
+        Z0.Add(1., *B0);
+        Z0.SetSubVector(ess_tdof_0, 0.);
 
-    //Recover solution on block vector          
-    for (int ii = block_offsets_H1[0]; ii < block_offsets_H1[1]; ii++)
-        dX_dt(ii) = dX0_dt(ii - block_offsets_H1[0]);   
-    for (int ii = block_offsets_H1[1]; ii < block_offsets_H1[2]; ii++)
-        dX_dt(ii) = dX1_dt(ii - block_offsets_H1[1]);
+        K1_pa->Mult(X1, Z1);
+        Z1.Neg();
+        Z1.Add(1., *B1);
+        Z1.SetSubVector(ess_tdof_1, 0.);
+
+        //Solve the system  
+        { Trace_Span span("M0 solve"); M0_pa_solver.Mult(Z0, dX0_dt); }
+        { Trace_Span span("M1 solve"); M1_pa_solver.Mult(Z1, dX1_dt); }
+        RecordSolve(linear_statistics[0], M0_pa_solver, Z0);
+        RecordSolve(linear_statistics[1], M1_pa_solver, Z1);
+    }
+
+    callback_allocations = max(callback_allocations, AllocationCount() - allocations);
 }
 
 //Setup the ODE Jacobian T = M + dt*K
 int Transport_Operator::SUNImplicitSetup(const Vector &X, const Vector &RHS, int j_update, int *j_status, double scaled_dt){
-    
+
+    Region_Timer timer(REGION_TRANSPORT_ASSEMBLY);
+
+    //Set dt for RHS (also when the Jacobian is kept, the RHS must use
+    //the current dt)
+    B0_dt.Set(scaled_dt, *B0);
+    B1_dt.Set(scaled_dt, *B1);
+
+    //Keep the previous Jacobian if ARKODE allows it, the coefficients
+    //were not refreshed and dt barely changed. SetParameters refreshes
+    //the coefficients once per step, so the Jacobian is only kept
+    //between setups of the same step (new stages or retries after a
+    //convergence failure), the summary reports how often
+    if (j_update && !jacobian_outdated && abs(scaled_dt/setup_dt - 1.) < config.jacobian_ratio){
+        jacobian_skipped++;
+        *j_status = 0;
+        return 0;
+    }
+    jacobian_setups++;
+    jacobian_outdated = false;
+    *j_status = 1;
+
+    if (config.partial_assembly){
+        SetPartialAssemblyJacobian(scaled_dt);
+        return 0;
+    }
+
+    setup_dt = scaled_dt;
+
     if (T0) delete T0;
     if (T0_e) delete T0_e;
     T0 = Add(1., *M0_o, scaled_dt, *K0);
     T0_e = T0->EliminateRowsCols(ess_tdof_0);
-    T0_prec.SetOperator(*T0);
     T0_solver.SetOperator(*T0);
 
     if (T1) delete T1;
     if (T1_e) delete T1_e;
     T1 = Add(1., *M1_o, scaled_dt, *K1);
     T1_e = T1->EliminateRowsCols(ess_tdof_1);
-    T1_prec.SetOperator(*T1);
     T1_solver.SetOperator(*T1);
 
-    //Set dt for RHS
-    B0_dt.Set(scaled_dt, *B0);
-    B1_dt.Set(scaled_dt, *B1);
-
-    *j_status = 1;
     return 0;
 }
 
 //From  M(dX_dt) + K(X) = B
 //Solve M(X_new - X) + dt*K(X_new) = dt*B for X_new
 int Transport_Operator::SUNImplicitSolve(const Vector &X, Vector &X_new, double tol){
+
+    Region_Timer timer(REGION_TRANSPORT_SOLVE);
+    long allocations = AllocationCount();
     
-    //Initialize the corresponding vectors
-    HypreParVector X0_new(&fespace_H1), X1_new(&fespace_H1);
-    HypreParVector X0(&fespace_H1),     X1(&fespace_H1);
-    for (int ii = block_offsets_H1[0]; ii < block_offsets_H1[1]; ii++)
-        X0(ii - block_offsets_H1[0]) = X(ii);
-    for (int ii = block_offsets_H1[1]; ii < block_offsets_H1[2]; ii++)
-        X1(ii - block_offsets_H1[1]) = X(ii);
-    Z0 = 0.;   Z1 = 0.;
-    X0_new = X0; X1_new = X1;
+    //Point the views to the blocks of X and X_new (X is the initial guess)
     X_new = X;
+    Z0 = 0.;   Z1 = 0.;
+    X0_view.SetData(const_cast<double*>(X.GetData()) + block_offsets_H1[0]);
+    X1_view.SetData(const_cast<double*>(X.GetData()) + block_offsets_H1[1]);
+    Y0_view.SetData(X_new.GetData() + block_offsets_H1[0]);
+    Y1_view.SetData(X_new.GetData() + block_offsets_H1[1]);
+    HypreParVector &X0 = X0_view, &X1 = X1_view;
+    HypreParVector &X0_new = Y0_view, &X1_new = Y1_view;
+
+    if (!config.partial_assembly){
+        //Set up RHS
+        M0_o->Mult(X0, Z0);
+        Z0.Add(1., B0_dt);
+        EliminateBC(*T0, *T0_e, ess_tdof_0, X0_new, Z0);
+
+        M1_o->Mult(X1, Z1);
+        Z1.Add(1., B1_dt);
+        EliminateBC(*T1, *T1_e, ess_tdof_1, X1_new, Z1);
 
-    //Set up RHS
-    M0_o->Mult(X0, Z0);
-    Z0.Add(1., B0_dt);
-    EliminateBC(*T0, *T0_e, ess_tdof_0, X0_new, Z0);
+        //Solve the system  
+        { Trace_Span span("T0 solve"); T0_solver.Mult(Z0, X0_new); }
+        { Trace_Span span("T1 solve"); T1_solver.Mult(Z1, X1_new); }
 
-    M1_o->Mult(X1, Z1);
-    Z1.Add(1., B1_dt);
-    EliminateBC(*T1, *T1_e, ess_tdof_1, X1_new, Z1);
+        //Check the quality of the reused hierarchies
+        int iterations;
+        T0_solver.GetNumIterations(iterations); T0_prec.Monitor(iterations);
+        T1_solver.GetNumIterations(iterations); T1_prec.Monitor(iterations);
+        RecordSolve(linear_statistics[2], T0_solver);
+        RecordSolve(linear_statistics[3], T1_solver);
+    } else {
+        //Set up RHS
+        M0_o_pa->Mult(X0, Z0);
+        Z0.Add(1., B0_dt);
+        T0_pa->EliminateRHS(X0_new, Z0);
 
-    //Solve the system  
-    T0_solver.Mult(Z0, X0_new); T1_solver.Mult(Z1, X1_new); 
+        M1_o_pa->Mult(X1, Z1);
+        Z1.Add(1., B1_dt);
+        T1_pa->EliminateRHS(X1_new, Z1);
 
-    //Recover solution on block vector          
-    for (int ii = block_offsets_H1[0]; ii < block_offsets_H1[1]; ii++)
-        X_new(ii) = X0_new(ii - block_offsets_H1[0]);   
-    for (int ii = block_offsets_H1[1]; ii < block_offsets_H1[2]; ii++)
-        X_new(ii) = X1_new(ii - block_offsets_H1[1]);
+        //Solve the system  
+        { Trace_Span span("T0 solve"); T0_pa_solver.Mult(Z0, X0_new); }
+        { Trace_Span span("T1 solve"); T1_pa_solver.Mult(Z1, X1_new); }
+        RecordSolve(linear_statistics[2], T0_pa_solver, Z0);
+        RecordSolve(linear_statistics[3], T1_pa_solver, Z1);
+    }
+
+    callback_allocations = max(callback_allocations, AllocationCount() - allocations);
 
     return 0;
 }
+
+//Statistics of the Jacobian setups (built and kept)
+int Transport_Operator::GetSetups() const{
+    return jacobian_setups;
+}
+
+int Transport_Operator::GetSkippedSetups() const{
+    return jacobian_skipped;
+}
+
+//Statistics of the AMG setups
+int Transport_Operator::GetAMGSetups() const{
+    return M0_prec.GetFullSetups() + M0_prec.GetReusedSetups() +
+           T0_prec.GetFullSetups() + T0_prec.GetReusedSetups() +
+           T1_prec.GetFullSetups() + T1_prec.GetReusedSetups();
+}
+
+int Transport_Operator::GetAMGReusedSetups() const{
+    return M0_prec.GetReusedSetups() + T0_prec.GetReusedSetups() + T1_prec.GetReusedSetups();
+}
+
+//Start the statistics of the linear solves again
+void Transport_Operator::ResetLinearStatistics(){
+    for (int ii = 0; ii < 4; ii++)
+        linear_statistics[ii] = {0, 0, 0.};
+}
+
+//Maximum heap allocations inside a single callback
+long Transport_Operator::GetCallbackAllocations() const{
+    return callback_allocations;
+}
+
+//Matrix-free version of the ODE Jacobian T = M + dt*K
+void Transport_Operator::SetPartialAssemblyJacobian(double scaled_dt){
+
+    setup_dt = scaled_dt;
+
+    if (T0_pa) delete T0_pa;
+    if (T0_pa_prec) delete T0_pa_prec;
+    T0_pa = new ConstrainedOperator(new SumOperator(M0_o_pa.Ptr(), 1., K0_pa, scaled_dt, false, false), ess_tdof_0, true);
+    T0_diag = M0_diag;
+    T0_diag.Add(scaled_dt, K0_diag);
+    T0_pa_prec = new OperatorJacobiSmoother(T0_diag, ess_tdof_0);
+    T0_pa_solver.SetPreconditioner(*T0_pa_prec);
+    T0_pa_solver.SetOperator(*T0_pa);
+
+    if (T1_pa) delete T1_pa;
+    if (T1_pa_prec) delete T1_pa_prec;
+    T1_pa = new ConstrainedOperator(new SumOperator(M1_o_pa.Ptr(), 1., K1_pa, scaled_dt, false, false), ess_tdof_1, true);
+    T1_diag = M1_diag;
+    T1_diag.Add(scaled_dt, K1_diag);
+    T1_pa_prec = new OperatorJacobiSmoother(T1_diag, ess_tdof_1);
+    T1_pa_solver.SetPreconditioner(*T1_pa_prec);
+    T1_pa_solver.SetOperator(*T1_pa);
+}
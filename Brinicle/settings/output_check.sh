@@ -0,0 +1,50 @@
+#!/bin/bash
+# Asynchronous against direct output on an adapted mesh (make output_check)
+#
+# The same short run with AMR is printed once by the I/O thread
+# (staged copy of the local meshes) and once directly by each
+# processor, and the files of both collections must be identical.
+# The parameters are restored at the end.
+
+STEPS=20
+AMR_STEPS=5
+
+cp settings/parameters.txt results/parameters_check.txt
+trap 'cp results/parameters_check.txt settings/parameters.txt; rm -f results/parameters_check.txt' EXIT
+
+#Replace the value of a line of the parameters
+set_parameter(){
+    sed -i "$1s/^[^ #]*/$2/" settings/parameters.txt
+}
+
+#Short run with the given asynchronous option
+run(){
+    LINES=$(wc -l < settings/parameters.txt)
+    set_parameter 14 $FINAL
+    set_parameter 66 $1
+    set_parameter $((LINES - 1)) 0
+    set_parameter $LINES 0
+    rm -rf results/graph/*
+    make main || exit 1
+}
+
+DT=$(sed -n 13p settings/parameters.txt | tr -d -c 0-9.)
+FINAL=$(awk "BEGIN {printf \"%.10f\", $STEPS*$DT}")
+set_parameter 55 $AMR_STEPS
+set_parameter 61 0
+set_parameter 62 0
+set_parameter 70 0
+set_parameter 71 0
+
+run 1
+rm -rf results/graph_async
+cp -r results/graph results/graph_async
+run 0
+
+if diff -r -q results/graph_async results/graph; then
+    echo 'Output check passed'
+    rm -rf results/graph_async
+else
+    echo 'Output check failed, the asynchronous output is kept in results/graph_async'
+    exit 1
+fi
@@ -0,0 +1,68 @@
+#!/bin/bash
+# Restart of an adapted mesh from a periodic checkpoint (make restart_check)
+#
+# A run with AMR writes a checkpoint every few steps, then the first
+# periodic checkpoint is made the latest one and the simulation is
+# restarted from it up to the same final time. The last diagnostics of
+# both runs must agree (ARKODE restarts its step size history, so they
+# are not bit identical). The parameters are restored at the end.
+
+TOLERANCE=0.001
+STEPS=20
+AMR_STEPS=5
+CHECKPOINT_STEPS=10
+
+cp settings/parameters.txt results/parameters_check.txt
+trap 'cp results/parameters_check.txt settings/parameters.txt; rm -f results/parameters_check.txt' EXIT
+
+#Replace the value of a line of the parameters
+set_parameter(){
+    sed -i "$1s/^[^ #]*/$2/" settings/parameters.txt
+}
+
+LINES=$(wc -l < settings/parameters.txt)
+DT=$(sed -n 13p settings/parameters.txt | tr -d -c 0-9.)
+FINAL=$(awk "BEGIN {printf \"%.10f\", $STEPS*$DT}")
+set_parameter 14 $FINAL
+set_parameter 55 $AMR_STEPS
+set_parameter 61 $CHECKPOINT_STEPS
+set_parameter 62 0
+set_parameter 63 100
+set_parameter 79 1
+set_parameter $((LINES - 1)) 0
+set_parameter $LINES 0
+
+#Continuous run
+rm -f results/restart/*.bin* results/restart/latest.txt
+make main || exit 1
+FULL=$(tail -n 1 results/diagnostics.txt)
+
+#Restart from the first periodic checkpoint
+NAME=$(ls results/restart | grep -m 1 '^checkpoint_.*\.bin\.000000$')
+[ -n "$NAME" ] || { echo 'No periodic checkpoint of an adapted mesh written'; exit 1; }
+NAME=${NAME%.000000}
+PROCESSORS=$(ls results/restart | grep -c "^$NAME\.")
+echo "$NAME $PROCESSORS" > results/restart/latest.txt
+TIME=$(od -A n -t f8 -j 32 -N 8 results/restart/$NAME.000000 | awk '{printf "%.10f", $1}')
+
+LINES=$(wc -l < settings/parameters.txt)
+set_parameter 14 $(awk "BEGIN {printf \"%.10f\", $FINAL - $TIME}")
+set_parameter $((LINES - 1)) 1
+set_parameter $LINES $TIME
+make main || exit 1
+RESTART=$(tail -n 1 results/diagnostics.txt)
+
+echo "Continuous run: $FULL"
+echo "Restarted run:  $RESTART"
+awk -F ',' -v full="$FULL" -v restart="$RESTART" -v tol=$TOLERANCE 'BEGIN {
+    n = split(full, a, ","); split(restart, b, ",")
+    error = 0
+    for (ii = 1; ii <= 6; ii++){
+        scale = (a[ii] < 0 ? -a[ii] : a[ii]) + 1e-30
+        diff = (a[ii] - b[ii] < 0 ? b[ii] - a[ii] : a[ii] - b[ii])/scale
+        if (diff > error) error = diff
+    }
+    printf "Maximum relative difference: %g\n", error
+    exit (error > tol)
+}' || { echo 'Restart check failed'; exit 1; }
+echo 'Restart check passed'
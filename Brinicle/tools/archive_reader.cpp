@@ -0,0 +1,188 @@
+#include "../code/header.h"
+#include <dirent.h>
+#include <cstring>
+#include <map>
+#include <set>
+
+//Reconstruction of the compressed archive of the visualization (see
+//code/output_writer.cpp) as a ParaView collection with all the pieces
+//joined. Usage: ./archive_reader.x [archive] [collection]
+
+//Read a whole file
+static string read_file(const string &name){
+    std::ifstream in(name.c_str(), std::ios::in | std::ios::binary);
+    MFEM_VERIFY(in.good(), "Cannot open " << name);
+    return string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+static void unpack(const string &buffer, size_t &position, T *data, long size){
+    MFEM_VERIFY(position + size*sizeof(T) <= buffer.size(), "Truncated archive");
+    memcpy(data, buffer.data() + position, size*sizeof(T));
+    position += size*sizeof(T);
+}
+
+//Meshes of the groups (in order) of one mesh of the archive, version 1
+//has a single mesh per group
+static void read_meshes(const string &folder, const std::set<int> &groups, int version, int index,
+                        std::vector<Mesh*> &pieces){
+    char name[64];
+    for (int group : groups){
+        if (version == 1)
+            snprintf(name, sizeof(name), "mesh_%06d.bin", group);
+        else
+            snprintf(name, sizeof(name), "mesh_%06d_%06d.bin", index, group);
+        string buffer = read_file(folder + name);
+        size_t position = 0;
+        int count;
+        unpack(buffer, position, &count, 1);
+        for (int ii = 0; ii < count; ii++){
+            long length;
+            unpack(buffer, position, &length, 1);
+            MFEM_VERIFY(position + length <= buffer.size(), "Truncated archive");
+            std::istringstream iss(buffer.substr(position, length));
+            position += length;
+            pieces.push_back(new Mesh(iss, 1, 0, false));
+        }
+    }
+}
+
+int main(int argc, char *argv[]){
+    MPI_Init(&argc, &argv);
+
+    string folder = (argc > 1) ? argv[1] : "results/archive";
+    string collection = (argc > 2) ? argv[2] : "results/graph";
+    folder += "/";
+
+    //Cycles and groups stored in the archive
+    std::map<int, std::set<int>> cycles;
+    DIR *directory = opendir(folder.c_str());
+    MFEM_VERIFY(directory, "Cannot open " << folder);
+    for (dirent *entry = readdir(directory); entry; entry = readdir(directory)){
+        int cycle, group;
+        if (sscanf(entry->d_name, "cycle_%d_%d.bin", &cycle, &group) == 2)
+            cycles[cycle].insert(group);
+    }
+    closedir(directory);
+    MFEM_VERIFY(!cycles.empty(), "No snapshots in " << folder);
+    std::set<int> groups = cycles.begin()->second;
+
+    //Pieces of the current mesh joined in one mesh, read again when
+    //the mesh of the snapshots changes (adapted meshes)
+    char name[64];
+    int current_mesh = -1;
+    std::vector<Mesh*> pieces;
+    Mesh *mesh = NULL;
+    FiniteElementCollection *fec_H1 = NULL, *fec_ND = NULL;
+    std::vector<FiniteElementSpace*> fespaces;
+    ParaViewDataCollection paraview(collection);
+    paraview.SetDataFormat(VTKFormat::BINARY);
+
+    long archive_bytes = 0, values = 0;
+    for (auto &entry : cycles){
+        MFEM_VERIFY(entry.second == groups, "Incomplete snapshot " << entry.first);
+
+        std::vector<string> names;
+        std::vector<int> nedelec;
+        std::vector<GridFunction*> piece_fields;
+        int piece = 0;
+        double time = 0.;
+
+        for (int group : groups){
+            snprintf(name, sizeof(name), "cycle_%06d_%06d.bin", entry.first, group);
+            string buffer = read_file(folder + name);
+            archive_bytes += buffer.size();
+
+            size_t position = 0;
+            char magic[8];
+            int header[6] = {0, 0, 0, 0, 0, 0};
+            unpack(buffer, position, magic, 8);
+            MFEM_VERIFY(memcmp(magic, "BRNARCHV", 8) == 0, "Invalid archive " << name);
+            unpack(buffer, position, header, 1);
+            MFEM_VERIFY(header[0] == 1 || header[0] == 2, "Unsupported archive version " << header[0]);
+            unpack(buffer, position, header + 1, (header[0] == 1) ? 4 : 5);
+            unpack(buffer, position, &time, 1);
+
+            //Pieces and spaces of the mesh of the snapshot
+            if (header[5] != current_mesh){
+                MFEM_VERIFY(piece == 0, "Groups with different meshes in snapshot " << entry.first);
+                for (unsigned int ii = 0; ii < fespaces.size(); ii++)
+                    delete fespaces[ii];
+                for (unsigned int ii = 0; ii < pieces.size(); ii++)
+                    delete pieces[ii];
+                delete mesh;
+                fespaces.clear();
+                pieces.clear();
+
+                current_mesh = header[5];
+                read_meshes(folder, groups, header[0], current_mesh, pieces);
+                mesh = new Mesh(pieces.data(), pieces.size());
+                paraview.SetMesh(mesh);
+
+                if (!fec_H1){
+                    fec_H1 = new H1_FECollection(header[1], mesh->Dimension());
+                    fec_ND = new ND_FECollection(header[1], mesh->Dimension());
+                    paraview.SetLevelsOfDetail(header[1]);
+                }
+                for (unsigned int ii = 0; ii < pieces.size(); ii++){
+                    fespaces.push_back(new FiniteElementSpace(pieces[ii], fec_H1));
+                    fespaces.push_back(new FiniteElementSpace(pieces[ii], fec_ND));
+                }
+            }
+
+            names.resize(header[4]);
+            nedelec.resize(header[4]);
+            for (int ii = 0; ii < header[4]; ii++){
+                int info[2];
+                unpack(buffer, position, info, 2);
+                nedelec[ii] = info[0];
+                names[ii].resize(info[1]);
+                unpack(buffer, position, &names[ii][0], info[1]);
+            }
+
+            for (int ii = 0; ii < header[3]; ii++, piece++){
+                for (int jj = 0; jj < header[4]; jj++){
+                    GridFunction *field = new GridFunction(fespaces[2*piece + nedelec[jj]]);
+                    int size = field->Size();
+                    DecompressField(buffer, position, *field);
+                    MFEM_VERIFY(field->Size() == size, "Archive does not match the mesh");
+                    values += size;
+                    piece_fields.push_back(field);
+                }
+            }
+        }
+        MFEM_VERIFY(piece == (int)pieces.size(), "Archive does not match the meshes");
+
+        //Join the pieces of each field and print them
+        std::vector<GridFunction*> fields(names.size());
+        std::vector<GridFunction*> field_pieces(pieces.size());
+        for (unsigned int ii = 0; ii < names.size(); ii++){
+            for (unsigned int jj = 0; jj < pieces.size(); jj++)
+                field_pieces[jj] = piece_fields[jj*names.size() + ii];
+            fields[ii] = new GridFunction(mesh, field_pieces.data(), pieces.size());
+            paraview.RegisterField(names[ii], fields[ii]);
+        }
+        paraview.SetCycle(entry.first);
+        paraview.SetTime(time);
+        paraview.Save();
+
+        for (unsigned int ii = 0; ii < fields.size(); ii++)
+            delete fields[ii];
+        for (unsigned int ii = 0; ii < piece_fields.size(); ii++)
+            delete piece_fields[ii];
+    }
+
+    cout << "Snapshots: " << cycles.size() << "\n"
+         << "Compression ratio: " << values*sizeof(double)/max(1., (double)archive_bytes) << "\n";
+
+    for (unsigned int ii = 0; ii < fespaces.size(); ii++)
+        delete fespaces[ii];
+    for (unsigned int ii = 0; ii < pieces.size(); ii++)
+        delete pieces[ii];
+    delete mesh;
+    delete fec_H1;
+    delete fec_ND;
+
+    MPI_Finalize();
+    return 0;
+}
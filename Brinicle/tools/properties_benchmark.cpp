@@ -0,0 +1,77 @@
+#include "../code/header.h"
+#include <chrono>
+#include <random>
+
+//Globals required by the physical properties
+double Epsilon, EpsilonInv;
+
+//Microbenchmark of the nodal evaluation of the physical properties:
+//scalar functions (as used by the old SetParameters loops) against
+//the batched kernel. Usage: ./properties_benchmark.x [nodes] [repetitions] [n_epsilon]
+int main(int argc, char *argv[]){
+
+    int size = (argc > 1) ? atoi(argv[1]) : 100000;
+    int repetitions = (argc > 2) ? atoi(argv[2]) : 50;
+    int nEpsilon = (argc > 3) ? atoi(argv[3]) : 2;
+    Epsilon = pow(10, -nEpsilon);
+    EpsilonInv = pow(10, nEpsilon);
+
+    //Random states around the fusion point
+    vector<double> T(size), S(size);
+    mt19937 generator(0);
+    uniform_real_distribution<double> random_T(-5., 10.), random_S(0., 60.);
+    for (int ii = 0; ii < size; ii++){
+        T[ii] = random_T(generator);
+        S[ii] = random_S(generator);
+    }
+
+    vector<double> P0(size), I0(size), D00(size), D10(size), K0(size), R0(size), T0(size);
+    vector<double> P1(size), I1(size), D01(size), D11(size), K1(size), R1(size), T1(size);
+
+    //Scalar version
+    auto start = chrono::steady_clock::now();
+    for (int rr = 0; rr < repetitions; rr++){
+        for (int ii = 0; ii < size; ii++){
+            I0[ii] = HeatInertia(T[ii], S[ii]);
+            D00[ii] = HeatDiffusivity(T[ii], S[ii]);
+            D10[ii] = SaltDiffusivity(T[ii], S[ii]);
+            P0[ii] = Phase(T[ii], S[ii]);
+            T0[ii] = T[ii] - FusionPoint(S[ii]);
+            K0[ii] = Impermeability(T[ii], S[ii]);
+            R0[ii] = Density(T[ii], S[ii]);
+        }
+    }
+    double time_scalar = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    //Batched version
+    Property_Fields fields;
+    fields.phase = P1.data();
+    fields.heat_inertia = I1.data();
+    fields.heat_diffusivity = D01.data();
+    fields.salt_diffusivity = D11.data();
+    fields.impermeability = K1.data();
+    fields.density = R1.data();
+    fields.temperature = T1.data();
+    start = chrono::steady_clock::now();
+    for (int rr = 0; rr < repetitions; rr++)
+        MaterialProperties(size, T.data(), S.data(), fields);
+    double time_batched = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    //Maximum relative difference between both versions
+    double error = 0.;
+    vector<double> *scalar[7] = {&P0, &I0, &D00, &D10, &K0, &R0, &T0};
+    vector<double> *batched[7] = {&P1, &I1, &D01, &D11, &K1, &R1, &T1};
+    for (int ff = 0; ff < 7; ff++)
+        for (int ii = 0; ii < size; ii++)
+            error = max(error, abs((*scalar[ff])[ii] - (*batched[ff])[ii])/(abs((*scalar[ff])[ii]) + 1E-12));
+
+    cout.precision(4);
+    cout << left << setw(24) << "Nodes: " << size << "\n"
+         << left << setw(24) << "Repetitions: " << repetitions << "\n"
+         << left << setw(24) << "Scalar (ns/node): " << 1E9*time_scalar/(size*(double)repetitions) << "\n"
+         << left << setw(24) << "Batched (ns/node): " << 1E9*time_batched/(size*(double)repetitions) << "\n"
+         << left << setw(24) << "Speedup: " << time_scalar/time_batched << "\n"
+         << left << setw(24) << "Max relative error: " << error << "\n";
+
+    return 0;
+}
@@ -0,0 +1,528 @@
+#include <mpi.h>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+/****
+ * MPI communication profiler (PMPI interposition). When this file is
+ * linked into main.x (MPI_PROFILER = 1 in local_config.mk) every wrapped
+ * MPI call records its count, bytes and time, grouped by the phase of
+ * the program that made it. The phase is the innermost region of the
+ * timers of the program (CurrentRegion), if it defines them. Each
+ * thread records in its own table indexed by phase and function, so
+ * no locks are taken on the calls, and the tables are merged at
+ * MPI_Finalize.
+ *
+ * At MPI_Finalize each rank writes results/mpi_profile_RRRRRR.txt and
+ * the master writes results/mpi_profile.txt with the min/avg/max time
+ * of each function over the ranks
+ ****/
+
+//Innermost phase of the calling thread (-1 outside of the phases) and
+//name of each phase, defined by the programs with timers
+extern "C" int CurrentRegion() __attribute__((weak));
+extern "C" const char *ProfilerRegionName(int region) __attribute__((weak));
+
+enum Function{
+    F_ALLREDUCE, F_REDUCE, F_BCAST, F_BARRIER, F_SCAN, F_EXSCAN,
+    F_GATHER, F_GATHERV, F_SCATTER, F_SCATTERV, F_ALLGATHER, F_ALLGATHERV,
+    F_ALLTOALL, F_ALLTOALLV,
+    F_IALLREDUCE, F_IREDUCE, F_IBCAST, F_IBARRIER, F_IGATHER, F_IGATHERV,
+    F_ISCATTER, F_ISCATTERV, F_IALLGATHER, F_IALLGATHERV, F_IALLTOALL, F_IALLTOALLV,
+    F_SEND, F_RECV, F_ISEND, F_IRECV, F_SENDRECV,
+    F_WAIT, F_WAITALL, F_WAITANY, F_WAITSOME, F_TEST, F_TESTALL, F_PROBE, F_IPROBE,
+    F_COUNT
+};
+
+static const char *function_names[F_COUNT] = {
+    "MPI_Allreduce", "MPI_Reduce", "MPI_Bcast", "MPI_Barrier", "MPI_Scan", "MPI_Exscan",
+    "MPI_Gather", "MPI_Gatherv", "MPI_Scatter", "MPI_Scatterv", "MPI_Allgather", "MPI_Allgatherv",
+    "MPI_Alltoall", "MPI_Alltoallv",
+    "MPI_Iallreduce", "MPI_Ireduce", "MPI_Ibcast", "MPI_Ibarrier", "MPI_Igather", "MPI_Igatherv",
+    "MPI_Iscatter", "MPI_Iscatterv", "MPI_Iallgather", "MPI_Iallgatherv", "MPI_Ialltoall", "MPI_Ialltoallv",
+    "MPI_Send", "MPI_Recv", "MPI_Isend", "MPI_Irecv", "MPI_Sendrecv",
+    "MPI_Wait", "MPI_Waitall", "MPI_Waitany", "MPI_Waitsome", "MPI_Test", "MPI_Testall", "MPI_Probe", "MPI_Iprobe"
+};
+
+struct Call_Statistics{
+    long calls = 0;
+    long bytes = 0;
+    double time = 0.;
+};
+
+//Statistics of a thread, the first phase is outside of the phases of
+//the program (and the ones beyond the table)
+static const int profile_phases = 64;
+
+struct Profile_Table{
+    Call_Statistics statistics[profile_phases][F_COUNT];
+};
+
+//Tables of all the threads and the ones released by finished threads
+static std::mutex profile_mutex;
+static std::vector<Profile_Table*> profile_tables;
+static std::vector<Profile_Table*> profile_free;
+static double profile_start = 0.;
+
+//Table of the current thread, released when the thread finishes
+struct Profile_Thread{
+    Profile_Table *table = NULL;
+    ~Profile_Thread(){
+        if (!table) return;
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        profile_free.push_back(table);
+    }
+};
+static thread_local Profile_Thread profile_thread;
+
+//Take a table for the current thread (only on its first call)
+static Profile_Table *profile_table(){
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    if (!profile_free.empty()){
+        Profile_Table *table = profile_free.back();
+        profile_free.pop_back();
+        return table;
+    }
+    Profile_Table *table = new Profile_Table;
+    profile_tables.push_back(table);
+    return table;
+}
+
+//Size of a message
+static long Bytes(int count, MPI_Datatype type){
+    if (type == MPI_DATATYPE_NULL || count <= 0) return 0;
+    int size;
+    PMPI_Type_size(type, &size);
+    return (long)count*size;
+}
+
+static long Bytes(int ranks, const int *counts, MPI_Datatype type){
+    long bytes = 0;
+    for (int ii = 0; ii < ranks; ii++)
+        bytes += Bytes(counts[ii], type);
+    return bytes;
+}
+
+static int Ranks(MPI_Comm comm){
+    int ranks;
+    PMPI_Comm_size(comm, &ranks);
+    return ranks;
+}
+
+//Add a call to the statistics of the current phase
+static void Record(Function function, long bytes, double start){
+    double time = PMPI_Wtime() - start;
+    Profile_Table *&table = profile_thread.table;
+    if (!table) table = profile_table();
+    int phase = CurrentRegion ? CurrentRegion() + 1 : 0;
+    if (phase < 0 || phase >= profile_phases) phase = 0;
+    Call_Statistics &statistics = table->statistics[phase][function];
+    statistics.calls++;
+    statistics.bytes += bytes;
+    statistics.time += time;
+}
+
+extern "C" {
+
+int MPI_Init(int *argc, char ***argv){
+    int result = PMPI_Init(argc, argv);
+    profile_start = PMPI_Wtime();
+    return result;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided){
+    int result = PMPI_Init_thread(argc, argv, required, provided);
+    profile_start = PMPI_Wtime();
+    return result;
+}
+
+//Collectives
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+    Record(F_ALLREDUCE, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Reduce(sendbuf, recvbuf, count, datatype, op, root, comm);
+    Record(F_REDUCE, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Bcast(buffer, count, datatype, root, comm);
+    Record(F_BCAST, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Barrier(MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Barrier(comm);
+    Record(F_BARRIER, 0, start);
+    return result;
+}
+
+int MPI_Scan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Scan(sendbuf, recvbuf, count, datatype, op, comm);
+    Record(F_SCAN, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Exscan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Exscan(sendbuf, recvbuf, count, datatype, op, comm);
+    Record(F_EXSCAN, Bytes(count, datatype), start);
+    return result;
+}
+
+//The bytes of the gathers and scatters are the ones sent by the rank
+int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+    Record(F_GATHER, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Gatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int displs[], MPI_Datatype recvtype, int root, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm);
+    Record(F_GATHERV, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    Record(F_SCATTER, (rank == root) ? Ranks(comm)*Bytes(sendcount, sendtype) : 0, start);
+    return result;
+}
+
+int MPI_Scatterv(const void *sendbuf, const int sendcounts[], const int displs[], MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Scatterv(sendbuf, sendcounts, displs, sendtype, recvbuf, recvcount, recvtype, root, comm);
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    Record(F_SCATTERV, (rank == root) ? Bytes(Ranks(comm), sendcounts, sendtype) : 0, start);
+    return result;
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+    Record(F_ALLGATHER, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int displs[], MPI_Datatype recvtype, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm);
+    Record(F_ALLGATHERV, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+    Record(F_ALLTOALL, Ranks(comm)*Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm);
+    Record(F_ALLTOALLV, Bytes(Ranks(comm), sendcounts, sendtype), start);
+    return result;
+}
+
+//Non-blocking collectives (the time of starting them, the waiting is
+//recorded by the completion calls)
+int MPI_Iallreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Iallreduce(sendbuf, recvbuf, count, datatype, op, comm, request);
+    Record(F_IALLREDUCE, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Ireduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Ireduce(sendbuf, recvbuf, count, datatype, op, root, comm, request);
+    Record(F_IREDUCE, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Ibcast(void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Ibcast(buffer, count, datatype, root, comm, request);
+    Record(F_IBCAST, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Ibarrier(MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Ibarrier(comm, request);
+    Record(F_IBARRIER, 0, start);
+    return result;
+}
+
+int MPI_Igather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Igather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm, request);
+    Record(F_IGATHER, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Igatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int displs[], MPI_Datatype recvtype, int root, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Igatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm, request);
+    Record(F_IGATHERV, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Iscatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Iscatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm, request);
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    Record(F_ISCATTER, (rank == root) ? Ranks(comm)*Bytes(sendcount, sendtype) : 0, start);
+    return result;
+}
+
+int MPI_Iscatterv(const void *sendbuf, const int sendcounts[], const int displs[], MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Iscatterv(sendbuf, sendcounts, displs, sendtype, recvbuf, recvcount, recvtype, root, comm, request);
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    Record(F_ISCATTERV, (rank == root) ? Bytes(Ranks(comm), sendcounts, sendtype) : 0, start);
+    return result;
+}
+
+int MPI_Iallgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Iallgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, request);
+    Record(F_IALLGATHER, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Iallgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int displs[], MPI_Datatype recvtype, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Iallgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm, request);
+    Record(F_IALLGATHERV, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Ialltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Ialltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, request);
+    Record(F_IALLTOALL, Ranks(comm)*Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+int MPI_Ialltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Ialltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm, request);
+    Record(F_IALLTOALLV, Bytes(Ranks(comm), sendcounts, sendtype), start);
+    return result;
+}
+
+//Point to point (the bytes are the ones sent, or posted to receive)
+int MPI_Send(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm){
+    double start = PMPI_Wtime();
+    int result = PMPI_Send(buf, count, datatype, dest, tag, comm);
+    Record(F_SEND, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Status *status){
+    double start = PMPI_Wtime();
+    int result = PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+    Record(F_RECV, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+    Record(F_ISEND, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Request *request){
+    double start = PMPI_Wtime();
+    int result = PMPI_Irecv(buf, count, datatype, source, tag, comm, request);
+    Record(F_IRECV, Bytes(count, datatype), start);
+    return result;
+}
+
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag, void *recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status *status){
+    double start = PMPI_Wtime();
+    int result = PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype, source, recvtag, comm, status);
+    Record(F_SENDRECV, Bytes(sendcount, sendtype), start);
+    return result;
+}
+
+//Completion (the time waiting for the messages)
+int MPI_Wait(MPI_Request *request, MPI_Status *status){
+    double start = PMPI_Wtime();
+    int result = PMPI_Wait(request, status);
+    Record(F_WAIT, 0, start);
+    return result;
+}
+
+int MPI_Waitall(int count, MPI_Request array_of_requests[], MPI_Status array_of_statuses[]){
+    double start = PMPI_Wtime();
+    int result = PMPI_Waitall(count, array_of_requests, array_of_statuses);
+    Record(F_WAITALL, 0, start);
+    return result;
+}
+
+int MPI_Waitany(int count, MPI_Request array_of_requests[], int *index, MPI_Status *status){
+    double start = PMPI_Wtime();
+    int result = PMPI_Waitany(count, array_of_requests, index, status);
+    Record(F_WAITANY, 0, start);
+    return result;
+}
+
+int MPI_Waitsome(int incount, MPI_Request array_of_requests[], int *outcount, int array_of_indices[], MPI_Status array_of_statuses[]){
+    double start = PMPI_Wtime();
+    int result = PMPI_Waitsome(incount, array_of_requests, outcount, array_of_indices, array_of_statuses);
+    Record(F_WAITSOME, 0, start);
+    return result;
+}
+
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status){
+    double start = PMPI_Wtime();
+    int result = PMPI_Test(request, flag, status);
+    Record(F_TEST, 0, start);
+    return result;
+}
+
+int MPI_Testall(int count, MPI_Request array_of_requests[], int *flag, MPI_Status array_of_statuses[]){
+    double start = PMPI_Wtime();
+    int result = PMPI_Testall(count, array_of_requests, flag, array_of_statuses);
+    Record(F_TESTALL, 0, start);
+    return result;
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status *status){
+    double start = PMPI_Wtime();
+    int result = PMPI_Probe(source, tag, comm, status);
+    Record(F_PROBE, 0, start);
+    return result;
+}
+
+int MPI_Iprobe(int source, int tag, MPI_Comm comm, int *flag, MPI_Status *status){
+    double start = PMPI_Wtime();
+    int result = PMPI_Iprobe(source, tag, comm, flag, status);
+    Record(F_IPROBE, 0, start);
+    return result;
+}
+
+//Print the summaries before closing MPI (the other threads must have
+//finished their calls)
+int MPI_Finalize(){
+    int rank, ranks;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    double elapsed = PMPI_Wtime() - profile_start;
+
+    //Merge the tables of the threads
+    Profile_Table *profile = new Profile_Table;
+    {
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        for (Profile_Table *table : profile_tables){
+            for (int pp = 0; pp < profile_phases; pp++){
+                for (int ii = 0; ii < F_COUNT; ii++){
+                    profile->statistics[pp][ii].calls += table->statistics[pp][ii].calls;
+                    profile->statistics[pp][ii].bytes += table->statistics[pp][ii].bytes;
+                    profile->statistics[pp][ii].time += table->statistics[pp][ii].time;
+                }
+            }
+        }
+    }
+
+    //Totals of each function over the phases
+    std::vector<Call_Statistics> totals(F_COUNT);
+    for (int pp = 0; pp < profile_phases; pp++){
+        for (int ii = 0; ii < F_COUNT; ii++){
+            totals[ii].calls += profile->statistics[pp][ii].calls;
+            totals[ii].bytes += profile->statistics[pp][ii].bytes;
+            totals[ii].time += profile->statistics[pp][ii].time;
+        }
+    }
+    double mpi_time = 0.;
+    for (int ii = 0; ii < F_COUNT; ii++)
+        mpi_time += totals[ii].time;
+
+    //Summary of the rank, the phases and functions by time
+    char name[64];
+    snprintf(name, sizeof(name), "results/mpi_profile_%06d.txt", rank);
+    FILE *out = fopen(name, "w");
+    if (!out){
+        snprintf(name, sizeof(name), "mpi_profile_%06d.txt", rank);
+        out = fopen(name, "w");
+    }
+    if (out){
+        fprintf(out, "Rank %d: %.6f s in MPI of %.6f s (%.2f %%)\n\n", rank, mpi_time, elapsed, 100*mpi_time/std::max(elapsed, 1E-12));
+        fprintf(out, "%-28s %-16s %12s %16s %14s\n", "Phase", "Function", "Calls", "Bytes", "Time (s)");
+        std::vector<std::pair<double, std::pair<int, int>>> rows;
+        for (int pp = 0; pp < profile_phases; pp++)
+            for (int ii = 0; ii < F_COUNT; ii++)
+                if (profile->statistics[pp][ii].calls > 0)
+                    rows.push_back({profile->statistics[pp][ii].time, {pp, ii}});
+        std::sort(rows.rbegin(), rows.rend());
+        for (auto &row : rows){
+            int phase = row.second.first;
+            const Call_Statistics &statistics = profile->statistics[phase][row.second.second];
+            const char *name = (phase > 0 && ProfilerRegionName) ? ProfilerRegionName(phase - 1) : NULL;
+            fprintf(out, "%-28s %-16s %12ld %16ld %14.6f\n", name ? name : "(none)",
+                    function_names[row.second.second], statistics.calls, statistics.bytes, statistics.time);
+        }
+        fclose(out);
+    }
+    delete profile;
+
+    //Time of each function over the ranks
+    double local[2*F_COUNT], minimum[2*F_COUNT], maximum[2*F_COUNT], sum[2*F_COUNT];
+    long calls[F_COUNT], bytes[F_COUNT];
+    for (int ii = 0; ii < F_COUNT; ii++){
+        local[ii] = totals[ii].time;
+        calls[ii] = totals[ii].calls;
+        bytes[ii] = totals[ii].bytes;
+    }
+    local[F_COUNT] = mpi_time;
+    local[F_COUNT + 1] = elapsed;
+    PMPI_Reduce(local, minimum, F_COUNT + 2, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(local, maximum, F_COUNT + 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(local, sum, F_COUNT + 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(rank == 0 ? MPI_IN_PLACE : calls, calls, F_COUNT, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(rank == 0 ? MPI_IN_PLACE : bytes, bytes, F_COUNT, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0){
+        out = fopen("results/mpi_profile.txt", "w");
+        if (!out) out = fopen("mpi_profile.txt", "w");
+        if (out){
+            fprintf(out, "Ranks: %d\n", ranks);
+            fprintf(out, "Time in MPI (min/avg/max): %.6f / %.6f / %.6f s of %.6f s\n\n",
+                    minimum[F_COUNT], sum[F_COUNT]/ranks, maximum[F_COUNT], maximum[F_COUNT + 1]);
+            fprintf(out, "%-16s %14s %18s %12s %12s %12s %10s\n", "Function", "Calls", "Bytes", "Min (s)", "Avg (s)", "Max (s)", "Max/avg");
+            for (int ii = 0; ii < F_COUNT; ii++){
+                if (calls[ii] == 0) continue;
+                double average = sum[ii]/ranks;
+                fprintf(out, "%-16s %14ld %18ld %12.6f %12.6f %12.6f %10.3f\n", function_names[ii], calls[ii], bytes[ii],
+                        minimum[ii], average, maximum[ii], maximum[ii]/std::max(average, 1E-12));
+            }
+            fclose(out);
+        }
+    }
+
+    return PMPI_Finalize();
+}
+
+}
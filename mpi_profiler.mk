@@ -0,0 +1,14 @@
+#MPI profiler (MPI_Profiler/pmpi.cpp), linked into main.x when
+#MPI_PROFILER = 1 in local_config.mk. Included by the Makefiles of the
+#programs after their DEPENDENCIES, the rule is a pattern so it is
+#never the default goal
+PROFILER_DIR := $(dir $(lastword $(MAKEFILE_LIST)))MPI_Profiler
+
+ifeq ($(MPI_PROFILER), 1)
+DEPENDENCIES += .objects/pmpi.o
+endif
+
+.objects/%.o: $(PROFILER_DIR)/%.cpp
+	@echo -e 'Building' $@ '... \c'
+	@$(CXX) $(FLAGS) -c $< -o $@
+	@echo -e 'Done!\n'